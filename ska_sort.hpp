@@ -5,21 +5,262 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <type_traits>
 #include <tuple>
 #include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SKA_SORT_SSE2
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SKA_SORT_AVX2
+#endif
+#if defined(SKA_SORT_SSE2) && defined(__x86_64__)
+#define SKA_SORT_NONTEMPORAL_STORES
+#endif
+#if defined(__SIZEOF_INT128__)
+#define SKA_SORT_INT128
+#endif
+
+// the thresholds below can be tuned for a machine by running
+// ska_sort_autotune, which writes a header that defines them. define
+// SKA_SORT_TUNING_HEADER to the name of that header to use it
+#ifdef SKA_SORT_TUNING_HEADER
+#include SKA_SORT_TUNING_HEADER
+#endif
+// the thresholds of the default ska_sort_policy, for elements of up to 8
+// bytes, up to 32 bytes and bigger than that
+#ifndef SKA_SORT_STD_SORT_THRESHOLD_SMALL
+#define SKA_SORT_STD_SORT_THRESHOLD_SMALL 128
+#endif
+#ifndef SKA_SORT_AMERICAN_FLAG_SORT_THRESHOLD_SMALL
+#define SKA_SORT_AMERICAN_FLAG_SORT_THRESHOLD_SMALL 1024
+#endif
+#ifndef SKA_SORT_STD_SORT_THRESHOLD_MEDIUM
+#define SKA_SORT_STD_SORT_THRESHOLD_MEDIUM 128
+#endif
+#ifndef SKA_SORT_AMERICAN_FLAG_SORT_THRESHOLD_MEDIUM
+#define SKA_SORT_AMERICAN_FLAG_SORT_THRESHOLD_MEDIUM 1024
+#endif
+#ifndef SKA_SORT_STD_SORT_THRESHOLD_LARGE
+#define SKA_SORT_STD_SORT_THRESHOLD_LARGE 128
+#endif
+#ifndef SKA_SORT_AMERICAN_FLAG_SORT_THRESHOLD_LARGE
+#define SKA_SORT_AMERICAN_FLAG_SORT_THRESHOLD_LARGE 1024
+#endif
+// the number of elements from which radix_sort switches to wider digits,
+// by key size in bytes
+#ifndef SKA_SORT_LSD_16_BIT_THRESHOLD_2
+#define SKA_SORT_LSD_16_BIT_THRESHOLD_2 (1 << 24)
+#endif
+#ifndef SKA_SORT_LSD_11_BIT_THRESHOLD_4
+#define SKA_SORT_LSD_11_BIT_THRESHOLD_4 (1 << 18)
+#endif
+#ifndef SKA_SORT_LSD_16_BIT_THRESHOLD_4
+#define SKA_SORT_LSD_16_BIT_THRESHOLD_4 (1 << 22)
+#endif
+#ifndef SKA_SORT_LSD_11_BIT_THRESHOLD_8
+#define SKA_SORT_LSD_11_BIT_THRESHOLD_8 (1 << 18)
+#endif
+#ifndef SKA_SORT_LSD_16_BIT_THRESHOLD_8
+#define SKA_SORT_LSD_16_BIT_THRESHOLD_8 (1 << 22)
+#endif
+// elements of at least this many bytes don't get moved by every radix sort
+// pass. instead the keys get sorted together with the index of their
+// element, and then every element gets moved once. ska_sort only moves the
+// elements that are out of place, so the crossover comes later than for
+// radix_sort, which moves every element in every pass
+#ifndef SKA_SORT_KEY_INDEX_THRESHOLD
+#define SKA_SORT_KEY_INDEX_THRESHOLD 256
+#endif
+#ifndef SKA_SORT_RADIX_SORT_KEY_INDEX_THRESHOLD
+#define SKA_SORT_RADIX_SORT_KEY_INDEX_THRESHOLD 64
+#endif
+
+// wraps a key so that it sorts in descending order. can be used for the
+// whole key or for single fields of a pair or tuple key, for example
+//     ska_sort(begin, end, [](const row & r){ return std::make_tuple(r.day, descending(r.score)); });
+// numbers are stored by value. other lvalues like strings are stored by
+// reference, so they have to outlive the key
+template<typename T>
+struct descending_key
+{
+    T value;
+};
+template<typename T>
+inline descending_key<typename std::conditional<std::is_scalar<typename std::decay<T>::type>::value, typename std::decay<T>::type, T>::type> descending(T && value)
+{
+    return { std::forward<T>(value) };
+}
+template<typename T, typename U>
+inline bool operator<(const descending_key<T> & lhs, const descending_key<U> & rhs)
+{
+    return rhs.value < lhs.value;
+}
+
+// sorts small ranges without another radix sort pass, see below
+struct cached_key_small_sort;
+
+// the tuning knobs of ska_sort:
+// - ranges with fewer than StdSortThreshold elements get sorted with
+//   SmallSort instead of another radix sort pass
+// - ranges with fewer than AmericanFlagSortThreshold elements get sorted
+//   with american flag sort instead of ska_byte_sort
+// - sorting a list key falls back to std::sort after ListRecursionLimit
+//   elements of the lists, to protect against long common prefixes
+// the best thresholds depend on the size of the elements and on how
+// expensive it is to swap them. ska_sort uses these defaults unless a
+// tuning header overrides them, see ska_sort_default_policy
+template<std::ptrdiff_t StdSortThreshold = 128, std::ptrdiff_t AmericanFlagSortThreshold = 1024, size_t ListRecursionLimit = 16, typename SmallSort = cached_key_small_sort>
+struct ska_sort_policy
+{
+    static constexpr std::ptrdiff_t std_sort_threshold = StdSortThreshold;
+    static constexpr std::ptrdiff_t american_flag_sort_threshold = AmericanFlagSortThreshold;
+    static constexpr size_t list_recursion_limit = ListRecursionLimit;
+    using small_sort = SmallSort;
+};
+
+// the policy that ska_sort uses for elements of the given size
+template<size_t ElementSize>
+using ska_sort_default_policy = ska_sort_policy<
+    ElementSize <= 8 ? SKA_SORT_STD_SORT_THRESHOLD_SMALL
+        : ElementSize <= 32 ? SKA_SORT_STD_SORT_THRESHOLD_MEDIUM
+        : SKA_SORT_STD_SORT_THRESHOLD_LARGE,
+    ElementSize <= 8 ? SKA_SORT_AMERICAN_FLAG_SORT_THRESHOLD_SMALL
+        : ElementSize <= 32 ? SKA_SORT_AMERICAN_FLAG_SORT_THRESHOLD_MEDIUM
+        : SKA_SORT_AMERICAN_FLAG_SORT_THRESHOLD_LARGE>;
 
 namespace detail
 {
+// adds the histogram in src to the one in dest. size has to be a multiple
+// of 256
+template<size_t CountSize>
+struct HistogramMerger
+{
+    template<typename count_type>
+    static void add(count_type * dest, const count_type * src, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+            dest[i] += src[i];
+    }
+};
+#ifdef SKA_SORT_SSE2
+template<>
+struct HistogramMerger<4>
+{
+    template<typename count_type>
+    static void add(count_type * dest, const count_type * src, size_t size)
+    {
+#ifdef SKA_SORT_AVX2
+        for (size_t i = 0; i < size; i += 8)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dest + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i), _mm256_add_epi32(a, b));
+        }
+#else
+        for (size_t i = 0; i < size; i += 4)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dest + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), _mm_add_epi32(a, b));
+        }
+#endif
+    }
+};
+template<>
+struct HistogramMerger<8>
+{
+    template<typename count_type>
+    static void add(count_type * dest, const count_type * src, size_t size)
+    {
+#ifdef SKA_SORT_AVX2
+        for (size_t i = 0; i < size; i += 4)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dest + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i), _mm256_add_epi64(a, b));
+        }
+#else
+        for (size_t i = 0; i < size; i += 2)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dest + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), _mm_add_epi64(a, b));
+        }
+#endif
+    }
+};
+#endif
+
+// when the same key shows up many times in a row, the increments of its
+// counter form a chain of dependent loads and stores. so for bigger inputs
+// the elements are counted round robin into several histograms which get
+// added up at the end. keys with more than two bytes already increment
+// enough independent counters per element to keep the cpu busy, and for
+// those the extra tables only cost cache space
+static constexpr size_t HistogramCopies = 4;
+static constexpr std::ptrdiff_t MultipleHistogramsThreshold = 4096;
+
+// counts holds NumDigits tables of 2^DigitBits entries, one for every digit
+// of the key, with the lowest digit first
+template<size_t NumDigits, size_t DigitBits, typename count_type, typename It, typename GetKey>
+inline void count_into(count_type * counts, It it, GetKey && get_key)
+{
+    static constexpr size_t bucket_count = size_t(1) << DigitBits;
+    auto key = get_key(*it);
+    for (size_t i = 0; i < NumDigits; ++i)
+        ++counts[i * bucket_count + ((key >> (i * DigitBits)) & (bucket_count - 1))];
+}
+template<size_t NumDigits, size_t DigitBits, typename count_type, typename It, typename GetKey>
+void build_multiple_histograms(It begin, It end, count_type * counts, GetKey && get_key)
+{
+    static constexpr size_t table_size = NumDigits << DigitBits;
+    count_type extra_counts[HistogramCopies - 1][table_size] = {};
+    for (std::ptrdiff_t remaining = end - begin; remaining >= std::ptrdiff_t(HistogramCopies); remaining -= HistogramCopies)
+    {
+        count_into<NumDigits, DigitBits>(counts, begin, get_key);
+        for (size_t i = 0; i < HistogramCopies - 1; ++i)
+            count_into<NumDigits, DigitBits>(extra_counts[i], begin + (i + 1), get_key);
+        begin += HistogramCopies;
+    }
+    for (; begin != end; ++begin)
+        count_into<NumDigits, DigitBits>(counts, begin, get_key);
+    for (auto & extra : extra_counts)
+        HistogramMerger<sizeof(count_type)>::add(counts, extra, table_size);
+}
+// counts the digits of get_key(element) for every element. counts has to
+// be zeroed before calling this
+template<size_t NumDigits, size_t DigitBits = 8, typename count_type, typename It, typename GetKey>
+void build_histograms(It begin, It end, count_type * counts, GetKey && get_key)
+{
+    if (NumDigits <= 2 && DigitBits == 8 && end - begin >= MultipleHistogramsThreshold)
+        build_multiple_histograms<NumDigits, DigitBits>(begin, end, counts, get_key);
+    else
+    {
+        for (; begin != end; ++begin)
+            count_into<NumDigits, DigitBits>(counts, begin, get_key);
+    }
+}
+
 template<typename count_type, typename It, typename OutIt, typename ExtractKey>
 void counting_sort_impl(It begin, It end, OutIt out_begin, ExtractKey && extract_key)
 {
     count_type counts[256] = {};
-    for (It it = begin; it != end; ++it)
-    {
-        ++counts[extract_key(*it)];
-    }
+    build_histograms<1>(begin, end, counts, extract_key);
     count_type total = 0;
     for (count_type & count : counts)
     {
@@ -38,6 +279,74 @@ void counting_sort_impl(It begin, It end, OutIt out_begin, ExtractKey && extract
 {
     counting_sort_impl<std::uint64_t>(begin, end, out_begin, extract_key);
 }
+// calls func(thread_index) on thread_count threads, one of which is the
+// calling thread, and returns once all of them are done
+template<typename Func>
+void run_in_parallel(size_t thread_count, Func && func)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (size_t i = 1; i < thread_count; ++i)
+    {
+        threads.emplace_back([&func, i]
+        {
+            func(i);
+        });
+    }
+    func(0);
+    for (std::thread & thread : threads)
+        thread.join();
+}
+// lets the threads of one run_in_parallel call wait for each other, so that
+// they can work through several phases without starting new threads for
+// every phase
+struct ThreadBarrier
+{
+    explicit ThreadBarrier(size_t thread_count)
+        : thread_count(thread_count)
+    {
+    }
+
+    // returns once all thread_count threads have called wait
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        size_t current_generation = generation;
+        if (++num_waiting == thread_count)
+        {
+            num_waiting = 0;
+            ++generation;
+            all_arrived.notify_all();
+        }
+        else
+            all_arrived.wait(lock, [&]{ return generation != current_generation; });
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable all_arrived;
+    size_t thread_count;
+    size_t num_waiting = 0;
+    size_t generation = 0;
+};
+// below this many elements per thread it's not worth starting threads
+static constexpr std::ptrdiff_t ParallelSortMinElementsPerThread = 1 << 14;
+
+inline size_t clamp_thread_count(size_t thread_count, std::ptrdiff_t num_elements)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min<size_t>(thread_count, num_elements / ParallelSortMinElementsPerThread));
+}
+
+template<typename It>
+inline std::pair<It, It> parallel_chunk(It begin, std::ptrdiff_t num_elements, size_t thread_count, size_t thread_index)
+{
+    std::ptrdiff_t chunk_size = (num_elements + thread_count - 1) / thread_count;
+    std::ptrdiff_t chunk_begin = std::min(num_elements, chunk_size * static_cast<std::ptrdiff_t>(thread_index));
+    std::ptrdiff_t chunk_end = std::min(num_elements, chunk_begin + chunk_size);
+    return { begin + chunk_begin, begin + chunk_end };
+}
 inline bool to_unsigned_or_bool(bool b)
 {
     return b;
@@ -123,283 +432,479 @@ inline size_t to_unsigned_or_bool(T * ptr)
 {
     return reinterpret_cast<size_t>(ptr);
 }
+#ifdef SKA_SORT_INT128
+inline unsigned __int128 to_unsigned_or_bool(__int128 i)
+{
+    return static_cast<unsigned __int128>(i) + (static_cast<unsigned __int128>(1) << 127);
+}
+inline unsigned __int128 to_unsigned_or_bool(unsigned __int128 i)
+{
+    return i;
+}
+#endif
 
-template<size_t>
-struct SizedRadixSorter;
+// flips a sub key so that sorting it ascending gives descending order.
+// lists get passed through because their elements are inverted one at a time
+inline bool invert_sub_key(bool b)
+{
+    return !b;
+}
+inline unsigned char invert_sub_key(unsigned char c)
+{
+    return static_cast<unsigned char>(~c);
+}
+inline unsigned short invert_sub_key(unsigned short i)
+{
+    return static_cast<unsigned short>(~i);
+}
+inline unsigned int invert_sub_key(unsigned int i)
+{
+    return ~i;
+}
+inline unsigned long invert_sub_key(unsigned long l)
+{
+    return ~l;
+}
+inline unsigned long long invert_sub_key(unsigned long long l)
+{
+    return ~l;
+}
+#ifdef SKA_SORT_INT128
+inline unsigned __int128 invert_sub_key(unsigned __int128 i)
+{
+    return ~i;
+}
+#endif
+template<typename T>
+inline const T & invert_sub_key(const T & list)
+{
+    return list;
+}
+template<typename T>
+inline auto to_unsigned_or_bool(const descending_key<T> & key) -> decltype(invert_sub_key(to_unsigned_or_bool(key.value)))
+{
+    return invert_sub_key(to_unsigned_or_bool(key.value));
+}
 
+template<size_t>
+struct UnsignedForSize;
 template<>
-struct SizedRadixSorter<1>
+struct UnsignedForSize<1>
 {
-    template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
+    typedef uint8_t type;
+};
+template<>
+struct UnsignedForSize<2>
+{
+    typedef uint16_t type;
+};
+template<>
+struct UnsignedForSize<4>
+{
+    typedef uint32_t type;
+};
+template<>
+struct UnsignedForSize<8>
+{
+    typedef uint64_t type;
+};
+#ifdef SKA_SORT_INT128
+template<>
+struct UnsignedForSize<16>
+{
+    typedef unsigned __int128 type;
+};
+#endif
+
+// fixed size byte arrays like hashes or uuids get sorted like one big-endian
+// number. they get read in chunks of up to eight bytes. a chunk at the end
+// that has fewer bytes gets read into the next bigger integer, padded with
+// zeros at the end
+constexpr size_t byte_chunk_size(size_t num_bytes)
+{
+    return num_bytes > 4 ? 8 : num_bytes > 2 ? 4 : num_bytes;
+}
+template<size_t Size, size_t Offset>
+struct ByteArrayChunk
+{
+    static constexpr size_t num_bytes = Size - Offset < 8 ? Size - Offset : 8;
+    using type = typename UnsignedForSize<byte_chunk_size(num_bytes)>::type;
+
+    static type load(const std::array<unsigned char, Size> & bytes)
     {
-        counting_sort_impl(begin, end, buffer_begin, [&](auto && o)
-        {
-            return to_unsigned_or_bool(extract_key(o));
-        });
-        return true;
+        type result = 0;
+        for (size_t i = 0; i < num_bytes; ++i)
+            result = static_cast<type>((result << 8) | bytes[Offset + i]);
+        return static_cast<type>(result << ((sizeof(type) - num_bytes) * 8));
     }
+};
+
+struct RadixSortSettings
+{
+    size_t thread_count = 1;
+    // stage the elements of every bucket in a cache line sized buffer and
+    // write them out a full line at a time, with non-temporal stores where
+    // available. only helps once the input no longer fits into the cache
+    bool write_combining = false;
+};
 
-    static constexpr size_t pass_count = 2;
+// stores that bypass the cache. falls back to a normal store for sizes or
+// platforms that don't have them
+template<size_t Size>
+struct NonTemporalStore
+{
+    static constexpr bool available = false;
+    static void store(void * dest, const void * src)
+    {
+        std::memcpy(dest, src, Size);
+    }
 };
+#ifdef SKA_SORT_NONTEMPORAL_STORES
 template<>
-struct SizedRadixSorter<2>
+struct NonTemporalStore<4>
 {
-    template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
+    static constexpr bool available = true;
+    static void store(void * dest, const void * src)
     {
-        std::ptrdiff_t num_elements = end - begin;
-        if (num_elements <= (1ll << 32))
-            return sort_inline<uint32_t>(begin, end, buffer_begin, buffer_begin + num_elements, extract_key);
-        else
-            return sort_inline<uint64_t>(begin, end, buffer_begin, buffer_begin + num_elements, extract_key);
+        int value;
+        std::memcpy(&value, src, sizeof(value));
+        _mm_stream_si32(static_cast<int *>(dest), value);
+    }
+};
+template<>
+struct NonTemporalStore<8>
+{
+    static constexpr bool available = true;
+    static void store(void * dest, const void * src)
+    {
+        long long value;
+        std::memcpy(&value, src, sizeof(value));
+        _mm_stream_si64(static_cast<long long *>(dest), value);
+    }
+};
+template<>
+struct NonTemporalStore<16>
+{
+    static constexpr bool available = true;
+    static void store(void * dest, const void * src)
+    {
+        NonTemporalStore<8>::store(dest, src);
+        NonTemporalStore<8>::store(static_cast<char *>(dest) + 8, static_cast<const char *>(src) + 8);
     }
+};
+#endif
 
-    template<typename count_type, typename It, typename OutIt, typename ExtractKey>
-    static bool sort_inline(It begin, It end, OutIt out_begin, OutIt out_end, ExtractKey && extract_key)
+template<typename It, typename OutIt, typename Enable = void>
+struct WriteCombiningScatter
+{
+    static constexpr bool available = false;
+};
+// the staging buffers hold raw bytes, so this only works for trivially
+// copyable types that are small enough to fit several into one cache line
+template<typename It, typename OutIt>
+struct WriteCombiningScatter<It, OutIt, typename std::enable_if<
+        std::is_same<typename std::iterator_traits<It>::value_type &, decltype(*std::declval<It>())>::value
+        && std::is_same<typename std::iterator_traits<It>::value_type &, decltype(*std::declval<OutIt>())>::value
+        && std::is_trivially_copyable<typename std::iterator_traits<It>::value_type>::value
+        && sizeof(typename std::iterator_traits<It>::value_type) <= 16>::type>
+{
+    static constexpr bool available = true;
+
+    using value_type = typename std::iterator_traits<It>::value_type;
+    static constexpr size_t CacheLineSize = 64;
+    static constexpr size_t ElementsPerLine = CacheLineSize / sizeof(value_type);
+
+    static void flush(OutIt out_begin, const unsigned char * line, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            NonTemporalStore<sizeof(value_type)>::store(std::addressof(out_begin[i]), line + i * sizeof(value_type));
+        }
+    }
+
+    static std::uint8_t first_flush_limit(const value_type * slot)
     {
-        count_type counts0[256] = {};
-        count_type counts1[256] = {};
+        std::uintptr_t offset = reinterpret_cast<std::uintptr_t>(slot) % CacheLineSize;
+        if (offset % sizeof(value_type))
+            return ElementsPerLine;
+        return static_cast<std::uint8_t>(ElementsPerLine - offset / sizeof(value_type));
+    }
 
-        for (It it = begin; it != end; ++it)
+    template<typename count_type, typename ExtractKey>
+    static void pass(It begin, It end, OutIt out_begin, count_type * counts, size_t shift, ExtractKey && extract_key)
+    {
+        alignas(CacheLineSize) unsigned char lines[256][CacheLineSize];
+        std::uint8_t fill[256] = {};
+        // the first flush of every bucket is cut short so that all later
+        // flushes start on a cache line boundary in the output. a partially
+        // written line is much more expensive for streaming stores. the
+        // limit gets computed when a bucket gets its first element, because
+        // the slot of an empty bucket can be past the end of the output
+        std::uint8_t limit[256] = {};
+        for (; begin != end; ++begin)
         {
-            uint16_t key = to_unsigned_or_bool(extract_key(*it));
-            ++counts0[key & 0xff];
-            ++counts1[(key >> 8) & 0xff];
+            std::uint8_t key = to_unsigned_or_bool(extract_key(*begin)) >> shift;
+            if (!limit[key])
+                limit[key] = first_flush_limit(std::addressof(out_begin[counts[key]]));
+            std::memcpy(lines[key] + fill[key] * sizeof(value_type), std::addressof(*begin), sizeof(value_type));
+            if (++fill[key] == limit[key])
+            {
+                flush(out_begin + counts[key], lines[key], fill[key]);
+                counts[key] += fill[key];
+                fill[key] = 0;
+                limit[key] = ElementsPerLine;
+            }
         }
-        count_type total0 = 0;
-        count_type total1 = 0;
         for (int i = 0; i < 256; ++i)
         {
-            count_type old_count0 = counts0[i];
-            count_type old_count1 = counts1[i];
-            counts0[i] = total0;
-            counts1[i] = total1;
-            total0 += old_count0;
-            total1 += old_count1;
+            flush(out_begin + counts[i], lines[i], fill[i]);
+            counts[i] += fill[i];
         }
-        for (It it = begin; it != end; ++it)
+#ifdef SKA_SORT_NONTEMPORAL_STORES
+        if (NonTemporalStore<sizeof(value_type)>::available)
+            _mm_sfence();
+#endif
+    }
+};
+
+// one stable counting sort pass over the digit at shift. counts has to hold
+// the starting offset of every bucket
+template<size_t DigitBits = 8, typename count_type, typename It, typename OutIt, typename ExtractKey>
+void radix_sort_pass(It begin, It end, OutIt out_begin, count_type * counts, size_t shift, ExtractKey && extract_key)
+{
+    for (; begin != end; ++begin)
+    {
+        size_t key = (to_unsigned_or_bool(extract_key(*begin)) >> shift) & ((size_t(1) << DigitBits) - 1);
+        out_begin[counts[key]++] = std::move(*begin);
+    }
+}
+template<typename count_type, typename It, typename OutIt, typename ExtractKey>
+typename std::enable_if<WriteCombiningScatter<It, OutIt>::available>::type radix_sort_pass(It begin, It end, OutIt out_begin, count_type * counts, size_t shift, ExtractKey && extract_key, const RadixSortSettings & settings)
+{
+    if (settings.write_combining)
+        WriteCombiningScatter<It, OutIt>::pass(begin, end, out_begin, counts, shift, extract_key);
+    else
+        radix_sort_pass(begin, end, out_begin, counts, shift, extract_key);
+}
+template<typename count_type, typename It, typename OutIt, typename ExtractKey>
+typename std::enable_if<!WriteCombiningScatter<It, OutIt>::available>::type radix_sort_pass(It begin, It end, OutIt out_begin, count_type * counts, size_t shift, ExtractKey && extract_key, const RadixSortSettings &)
+{
+    radix_sort_pass(begin, end, out_begin, counts, shift, extract_key);
+}
+
+// one stable counting sort pass over the byte at shift, run by every thread
+// on its own chunk. every thread counts its chunk, and the prefix sum goes
+// over buckets first and threads second, so that every thread scatters into
+// its own disjoint ranges of the output. every thread does the prefix sum
+// for its own offsets, so the threads only wait for each other after
+// counting and after scattering. returns false without moving anything if
+// all elements have the same byte
+template<typename It, typename OutIt, typename ExtractKey>
+bool parallel_radix_sort_pass(It begin, std::ptrdiff_t num_elements, OutIt out_begin, size_t shift, ExtractKey && extract_key, const RadixSortSettings & settings, std::array<size_t, 256> * counts, size_t thread_index, ThreadBarrier & barrier)
+{
+    size_t thread_count = settings.thread_count;
+    std::pair<It, It> chunk = parallel_chunk(begin, num_elements, thread_count, thread_index);
+    std::array<size_t, 256> & thread_counts = counts[thread_index];
+    thread_counts.fill(0);
+    for (It it = chunk.first; it != chunk.second; ++it)
+    {
+        std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> shift;
+        ++thread_counts[key];
+    }
+    barrier.wait();
+    std::array<size_t, 256> offsets;
+    size_t total = 0;
+    for (int i = 0; i < 256; ++i)
+    {
+        size_t bucket_begin = total;
+        for (size_t other = 0; other < thread_count; ++other)
         {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it));
-            out_begin[counts0[key]++] = std::move(*it);
+            if (other == thread_index)
+                offsets[i] = total;
+            total += counts[other][i];
         }
-        for (OutIt it = out_begin; it != out_end; ++it)
+        if (total - bucket_begin == static_cast<size_t>(num_elements))
+            return false;
+    }
+    radix_sort_pass(chunk.first, chunk.second, out_begin, offsets.data(), shift, extract_key, settings);
+    // the next pass reads what the other threads wrote
+    barrier.wait();
+    return true;
+}
+
+// starts the threads once and runs every pass on them. the passes take
+// turns using two sets of counts: a thread that is done with a pass can
+// start counting the next one while the others still read the counts of
+// this one
+template<size_t NumBytes, typename It, typename OutIt, typename ExtractKey>
+bool parallel_radix_sort_impl(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings)
+{
+    std::ptrdiff_t num_elements = end - begin;
+    size_t thread_count = settings.thread_count;
+    std::vector<std::array<size_t, 256>> counts(2 * thread_count);
+    ThreadBarrier barrier(thread_count);
+    bool result = false;
+    run_in_parallel(thread_count, [&](size_t thread_index)
+    {
+        bool in_buffer = false;
+        for (size_t byte = 0; byte < NumBytes; ++byte)
         {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> 8;
-            begin[counts1[key]++] = std::move(*it);
+            std::array<size_t, 256> * pass_counts = counts.data() + (byte % 2) * thread_count;
+            if (in_buffer)
+                in_buffer = !parallel_radix_sort_pass(buffer_begin, num_elements, begin, byte * 8, extract_key, settings, pass_counts, thread_index, barrier);
+            else
+                in_buffer = parallel_radix_sort_pass(begin, num_elements, buffer_begin, byte * 8, extract_key, settings, pass_counts, thread_index, barrier);
         }
-        return false;
-    }
+        // every thread made the same decisions
+        if (thread_index == 0)
+            result = in_buffer;
+    });
+    return result;
+}
 
-    static constexpr size_t pass_count = 3;
+// histogram storage for sort_inline. the tables for wide digits are too big
+// for the stack
+template<typename count_type, size_t Size, bool OnStack = Size * sizeof(count_type) <= 16384>
+struct CountTables
+{
+    count_type counts[Size] = {};
+    count_type * data()
+    {
+        return counts;
+    }
 };
-template<>
-struct SizedRadixSorter<4>
+template<typename count_type, size_t Size>
+struct CountTables<count_type, Size, false>
+{
+    std::unique_ptr<count_type[]> counts{new count_type[Size]()};
+    count_type * data()
+    {
+        return counts.get();
+    }
+};
+
+// the width of the digits that a key of NumBytes bytes gets sorted by.
+// wider digits mean fewer passes over the data, but a histogram that has
+// to be cleared and summed, and more places to scatter to at once. so
+// they only pay off when there are enough elements for every bucket
+template<size_t NumBytes>
+constexpr size_t radix_digit_bits(std::ptrdiff_t num_elements)
 {
+    return NumBytes == 2 ? (num_elements >= SKA_SORT_LSD_16_BIT_THRESHOLD_2 ? 16 : 8)
+        : NumBytes == 4 ? (num_elements >= SKA_SORT_LSD_16_BIT_THRESHOLD_4 ? 16 : num_elements >= SKA_SORT_LSD_11_BIT_THRESHOLD_4 ? 11 : 8)
+        : NumBytes >= 8 ? (num_elements >= SKA_SORT_LSD_16_BIT_THRESHOLD_8 ? 16 : num_elements >= SKA_SORT_LSD_11_BIT_THRESHOLD_8 ? 11 : 8)
+        : 8;
+}
 
+template<size_t NumBytes>
+struct SizedRadixSorter
+{
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
+    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings)
     {
+        if (settings.thread_count > 1)
+            return parallel_radix_sort_impl<NumBytes>(begin, end, buffer_begin, extract_key, settings);
         std::ptrdiff_t num_elements = end - begin;
         if (num_elements <= (1ll << 32))
-            return sort_inline<uint32_t>(begin, end, buffer_begin, buffer_begin + num_elements, extract_key);
+            return sort_with_digit_bits<uint32_t>(begin, end, buffer_begin, buffer_begin + num_elements, extract_key, settings);
         else
-            return sort_inline<uint64_t>(begin, end, buffer_begin, buffer_begin + num_elements, extract_key);
+            return sort_with_digit_bits<uint64_t>(begin, end, buffer_begin, buffer_begin + num_elements, extract_key, settings);
     }
     template<typename count_type, typename It, typename OutIt, typename ExtractKey>
-    static bool sort_inline(It begin, It end, OutIt out_begin, OutIt out_end, ExtractKey && extract_key)
+    static bool sort_with_digit_bits(It begin, It end, OutIt out_begin, OutIt out_end, ExtractKey && extract_key, const RadixSortSettings & settings)
     {
-        count_type counts0[256] = {};
-        count_type counts1[256] = {};
-        count_type counts2[256] = {};
-        count_type counts3[256] = {};
-
-        for (It it = begin; it != end; ++it)
+        // the write combining buffers only exist for bytes
+        if (settings.write_combining)
+            return sort_inline<count_type, 8>(begin, end, out_begin, out_end, extract_key, settings);
+        // only instantiate the widths that radix_digit_bits can pick
+        static constexpr size_t wide_bits = NumBytes >= 2 ? 16 : 8;
+        static constexpr size_t medium_bits = NumBytes >= 4 ? 11 : 8;
+        switch (radix_digit_bits<NumBytes>(end - begin))
         {
-            uint32_t key = to_unsigned_or_bool(extract_key(*it));
-            ++counts0[key & 0xff];
-            ++counts1[(key >> 8) & 0xff];
-            ++counts2[(key >> 16) & 0xff];
-            ++counts3[(key >> 24) & 0xff];
+        case 16:
+            return sort_inline<count_type, wide_bits>(begin, end, out_begin, out_end, extract_key, settings);
+        case 11:
+            return sort_inline<count_type, medium_bits>(begin, end, out_begin, out_end, extract_key, settings);
+        default:
+            return sort_inline<count_type, 8>(begin, end, out_begin, out_end, extract_key, settings);
         }
-        count_type total0 = 0;
-        count_type total1 = 0;
-        count_type total2 = 0;
-        count_type total3 = 0;
-        for (int i = 0; i < 256; ++i)
-        {
-            count_type old_count0 = counts0[i];
-            count_type old_count1 = counts1[i];
-            count_type old_count2 = counts2[i];
-            count_type old_count3 = counts3[i];
-            counts0[i] = total0;
-            counts1[i] = total1;
-            counts2[i] = total2;
-            counts3[i] = total3;
-            total0 += old_count0;
-            total1 += old_count1;
-            total2 += old_count2;
-            total3 += old_count3;
-        }
-        for (It it = begin; it != end; ++it)
-        {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it));
-            out_begin[counts0[key]++] = std::move(*it);
-        }
-        for (OutIt it = out_begin; it != out_end; ++it)
+    }
+    template<typename count_type, size_t DigitBits, typename It, typename OutIt, typename ExtractKey>
+    static bool sort_inline(It begin, It end, OutIt out_begin, OutIt out_end, ExtractKey && extract_key, const RadixSortSettings & settings)
+    {
+        static constexpr size_t num_digits = (NumBytes * 8 + DigitBits - 1) / DigitBits;
+        static constexpr size_t bucket_count = size_t(1) << DigitBits;
+        CountTables<count_type, num_digits * bucket_count> tables;
+        count_type * counts = tables.data();
+        build_histograms<num_digits, DigitBits>(begin, end, counts, [&](auto && o)
         {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> 8;
-            begin[counts1[key]++] = std::move(*it);
-        }
-        for (It it = begin; it != end; ++it)
+            return to_unsigned_or_bool(extract_key(o));
+        });
+        // if all elements have the same value for a digit, the pass for that
+        // digit wouldn't change the order, so it gets skipped
+        count_type num_elements = end - begin;
+        bool skip_pass[num_digits] = {};
+        for (size_t i = 0; i < num_digits; ++i)
         {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> 16;
-            out_begin[counts2[key]++] = std::move(*it);
+            count_type total = 0;
+            for (count_type * count = counts + i * bucket_count, * count_end = count + bucket_count; count != count_end; ++count)
+            {
+                count_type old_count = *count;
+                if (old_count == num_elements)
+                    skip_pass[i] = true;
+                *count = total;
+                total += old_count;
+            }
         }
-        for (OutIt it = out_begin; it != out_end; ++it)
+        bool in_buffer = false;
+        for (size_t i = 0; i < num_digits; ++i)
         {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> 24;
-            begin[counts3[key]++] = std::move(*it);
+            if (skip_pass[i])
+                continue;
+            count_type * digit_counts = counts + i * bucket_count;
+            if (DigitBits != 8)
+            {
+                if (in_buffer)
+                    radix_sort_pass<DigitBits>(out_begin, out_end, begin, digit_counts, i * DigitBits, extract_key);
+                else
+                    radix_sort_pass<DigitBits>(begin, end, out_begin, digit_counts, i * DigitBits, extract_key);
+            }
+            else if (in_buffer)
+                radix_sort_pass(out_begin, out_end, begin, digit_counts, i * 8, extract_key, settings);
+            else
+                radix_sort_pass(begin, end, out_begin, digit_counts, i * 8, extract_key, settings);
+            in_buffer = !in_buffer;
         }
-        return false;
+        return in_buffer;
     }
 
-    static constexpr size_t pass_count = 5;
+    // the number of passes over the data: one to build the histograms plus
+    // one per digit
+    static constexpr size_t pass_count(std::ptrdiff_t num_elements)
+    {
+        return (NumBytes * 8 + radix_digit_bits<NumBytes>(num_elements) - 1) / radix_digit_bits<NumBytes>(num_elements) + 1;
+    }
 };
+
+template<typename>
+struct RadixSorter;
 template<>
-struct SizedRadixSorter<8>
+struct RadixSorter<bool>
 {
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
-    {
-        std::ptrdiff_t num_elements = end - begin;
-        if (num_elements <= (1ll << 32))
-            return sort_inline<uint32_t>(begin, end, buffer_begin, buffer_begin + num_elements, extract_key);
-        else
-            return sort_inline<uint64_t>(begin, end, buffer_begin, buffer_begin + num_elements, extract_key);
-    }
-    template<typename count_type, typename It, typename OutIt, typename ExtractKey>
-    static bool sort_inline(It begin, It end, OutIt out_begin, OutIt out_end, ExtractKey && extract_key)
+    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings)
     {
-        count_type counts0[256] = {};
-        count_type counts1[256] = {};
-        count_type counts2[256] = {};
-        count_type counts3[256] = {};
-        count_type counts4[256] = {};
-        count_type counts5[256] = {};
-        count_type counts6[256] = {};
-        count_type counts7[256] = {};
-
+        if (settings.thread_count > 1)
+            return parallel_radix_sort_impl<1>(begin, end, buffer_begin, extract_key, settings);
+        size_t false_count = 0;
         for (It it = begin; it != end; ++it)
         {
-            uint64_t key = to_unsigned_or_bool(extract_key(*it));
-            ++counts0[key & 0xff];
-            ++counts1[(key >> 8) & 0xff];
-            ++counts2[(key >> 16) & 0xff];
-            ++counts3[(key >> 24) & 0xff];
-            ++counts4[(key >> 32) & 0xff];
-            ++counts5[(key >> 40) & 0xff];
-            ++counts6[(key >> 48) & 0xff];
-            ++counts7[(key >> 56) & 0xff];
+            if (!extract_key(*it))
+                ++false_count;
         }
-        count_type total0 = 0;
-        count_type total1 = 0;
-        count_type total2 = 0;
-        count_type total3 = 0;
-        count_type total4 = 0;
-        count_type total5 = 0;
-        count_type total6 = 0;
-        count_type total7 = 0;
-        for (int i = 0; i < 256; ++i)
-        {
-            count_type old_count0 = counts0[i];
-            count_type old_count1 = counts1[i];
-            count_type old_count2 = counts2[i];
-            count_type old_count3 = counts3[i];
-            count_type old_count4 = counts4[i];
-            count_type old_count5 = counts5[i];
-            count_type old_count6 = counts6[i];
-            count_type old_count7 = counts7[i];
-            counts0[i] = total0;
-            counts1[i] = total1;
-            counts2[i] = total2;
-            counts3[i] = total3;
-            counts4[i] = total4;
-            counts5[i] = total5;
-            counts6[i] = total6;
-            counts7[i] = total7;
-            total0 += old_count0;
-            total1 += old_count1;
-            total2 += old_count2;
-            total3 += old_count3;
-            total4 += old_count4;
-            total5 += old_count5;
-            total6 += old_count6;
-            total7 += old_count7;
-        }
-        for (It it = begin; it != end; ++it)
-        {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it));
-            out_begin[counts0[key]++] = std::move(*it);
-        }
-        for (OutIt it = out_begin; it != out_end; ++it)
-        {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> 8;
-            begin[counts1[key]++] = std::move(*it);
-        }
-        for (It it = begin; it != end; ++it)
-        {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> 16;
-            out_begin[counts2[key]++] = std::move(*it);
-        }
-        for (OutIt it = out_begin; it != out_end; ++it)
-        {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> 24;
-            begin[counts3[key]++] = std::move(*it);
-        }
-        for (It it = begin; it != end; ++it)
-        {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> 32;
-            out_begin[counts4[key]++] = std::move(*it);
-        }
-        for (OutIt it = out_begin; it != out_end; ++it)
-        {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> 40;
-            begin[counts5[key]++] = std::move(*it);
-        }
-        for (It it = begin; it != end; ++it)
-        {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> 48;
-            out_begin[counts6[key]++] = std::move(*it);
-        }
-        for (OutIt it = out_begin; it != out_end; ++it)
-        {
-            std::uint8_t key = to_unsigned_or_bool(extract_key(*it)) >> 56;
-            begin[counts7[key]++] = std::move(*it);
-        }
-        return false;
-    }
-
-    static constexpr size_t pass_count = 9;
-};
-
-template<typename>
-struct RadixSorter;
-template<>
-struct RadixSorter<bool>
-{
-    template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
-    {
-        size_t false_count = 0;
-        for (It it = begin; it != end; ++it)
-        {
-            if (!extract_key(*it))
-                ++false_count;
-        }
-        size_t true_position = false_count;
-        false_count = 0;
-        for (; begin != end; ++begin)
+        size_t true_position = false_count;
+        false_count = 0;
+        for (; begin != end; ++begin)
         {
             if (extract_key(*begin))
                 buffer_begin[true_position++] = std::move(*begin);
@@ -409,7 +914,10 @@ struct RadixSorter<bool>
         return true;
     }
 
-    static constexpr size_t pass_count = 2;
+    static constexpr size_t pass_count(std::ptrdiff_t)
+    {
+        return 2;
+    }
 };
 template<>
 struct RadixSorter<signed char> : SizedRadixSorter<sizeof(signed char)>
@@ -475,16 +983,26 @@ template<>
 struct RadixSorter<char32_t> : SizedRadixSorter<sizeof(char32_t)>
 {
 };
+#ifdef SKA_SORT_INT128
+template<>
+struct RadixSorter<__int128> : SizedRadixSorter<16>
+{
+};
+template<>
+struct RadixSorter<unsigned __int128> : SizedRadixSorter<16>
+{
+};
+#endif
 template<typename K, typename V>
 struct RadixSorter<std::pair<K, V>>
 {
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
+    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings)
     {
         bool first_result = RadixSorter<V>::sort(begin, end, buffer_begin, [&](auto && o)
         {
             return extract_key(o).second;
-        });
+        }, settings);
         auto extract_first = [&](auto && o)
         {
             return extract_key(o).first;
@@ -492,26 +1010,29 @@ struct RadixSorter<std::pair<K, V>>
 
         if (first_result)
         {
-            return !RadixSorter<K>::sort(buffer_begin, buffer_begin + (end - begin), begin, extract_first);
+            return !RadixSorter<K>::sort(buffer_begin, buffer_begin + (end - begin), begin, extract_first, settings);
         }
         else
         {
-            return RadixSorter<K>::sort(begin, end, buffer_begin, extract_first);
+            return RadixSorter<K>::sort(begin, end, buffer_begin, extract_first, settings);
         }
     }
 
-    static constexpr size_t pass_count = RadixSorter<K>::pass_count + RadixSorter<V>::pass_count;
+    static constexpr size_t pass_count(std::ptrdiff_t num_elements)
+    {
+        return RadixSorter<K>::pass_count(num_elements) + RadixSorter<V>::pass_count(num_elements);
+    }
 };
 template<typename K, typename V>
 struct RadixSorter<const std::pair<K, V> &>
 {
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
+    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings)
     {
         bool first_result = RadixSorter<V>::sort(begin, end, buffer_begin, [&](auto && o) -> const V &
         {
             return extract_key(o).second;
-        });
+        }, settings);
         auto extract_first = [&](auto && o) -> const K &
         {
             return extract_key(o).first;
@@ -519,15 +1040,18 @@ struct RadixSorter<const std::pair<K, V> &>
 
         if (first_result)
         {
-            return !RadixSorter<K>::sort(buffer_begin, buffer_begin + (end - begin), begin, extract_first);
+            return !RadixSorter<K>::sort(buffer_begin, buffer_begin + (end - begin), begin, extract_first, settings);
         }
         else
         {
-            return RadixSorter<K>::sort(begin, end, buffer_begin, extract_first);
+            return RadixSorter<K>::sort(begin, end, buffer_begin, extract_first, settings);
         }
     }
 
-    static constexpr size_t pass_count = RadixSorter<K>::pass_count + RadixSorter<V>::pass_count;
+    static constexpr size_t pass_count(std::ptrdiff_t num_elements)
+    {
+        return RadixSorter<K>::pass_count(num_elements) + RadixSorter<V>::pass_count(num_elements);
+    }
 };
 template<size_t I, size_t S, typename Tuple>
 struct TupleRadixSorter
@@ -536,20 +1060,23 @@ struct TupleRadixSorter
     using ThisSorter = RadixSorter<typename std::tuple_element<I, Tuple>::type>;
 
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt out_begin, OutIt out_end, ExtractKey && extract_key)
+    static bool sort(It begin, It end, OutIt out_begin, OutIt out_end, ExtractKey && extract_key, const RadixSortSettings & settings)
     {
-        bool which = NextSorter::sort(begin, end, out_begin, out_end, extract_key);
+        bool which = NextSorter::sort(begin, end, out_begin, out_end, extract_key, settings);
         auto extract_i = [&](auto && o)
         {
             return std::get<I>(extract_key(o));
         };
         if (which)
-            return !ThisSorter::sort(out_begin, out_end, begin, extract_i);
+            return !ThisSorter::sort(out_begin, out_end, begin, extract_i, settings);
         else
-            return ThisSorter::sort(begin, end, out_begin, extract_i);
+            return ThisSorter::sort(begin, end, out_begin, extract_i, settings);
     }
 
-    static constexpr size_t pass_count = ThisSorter::pass_count + NextSorter::pass_count;
+    static constexpr size_t pass_count(std::ptrdiff_t num_elements)
+    {
+        return ThisSorter::pass_count(num_elements) + NextSorter::pass_count(num_elements);
+    }
 };
 template<size_t I, size_t S, typename Tuple>
 struct TupleRadixSorter<I, S, const Tuple &>
@@ -558,42 +1085,51 @@ struct TupleRadixSorter<I, S, const Tuple &>
     using ThisSorter = RadixSorter<typename std::tuple_element<I, Tuple>::type>;
 
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt out_begin, OutIt out_end, ExtractKey && extract_key)
+    static bool sort(It begin, It end, OutIt out_begin, OutIt out_end, ExtractKey && extract_key, const RadixSortSettings & settings)
     {
-        bool which = NextSorter::sort(begin, end, out_begin, out_end, extract_key);
+        bool which = NextSorter::sort(begin, end, out_begin, out_end, extract_key, settings);
         auto extract_i = [&](auto && o) -> decltype(auto)
         {
             return std::get<I>(extract_key(o));
         };
         if (which)
-            return !ThisSorter::sort(out_begin, out_end, begin, extract_i);
+            return !ThisSorter::sort(out_begin, out_end, begin, extract_i, settings);
         else
-            return ThisSorter::sort(begin, end, out_begin, extract_i);
+            return ThisSorter::sort(begin, end, out_begin, extract_i, settings);
     }
 
-    static constexpr size_t pass_count = ThisSorter::pass_count + NextSorter::pass_count;
+    static constexpr size_t pass_count(std::ptrdiff_t num_elements)
+    {
+        return ThisSorter::pass_count(num_elements) + NextSorter::pass_count(num_elements);
+    }
 };
 template<size_t I, typename Tuple>
 struct TupleRadixSorter<I, I, Tuple>
 {
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It, It, OutIt, OutIt, ExtractKey &&)
+    static bool sort(It, It, OutIt, OutIt, ExtractKey &&, const RadixSortSettings &)
     {
         return false;
     }
 
-    static constexpr size_t pass_count = 0;
+    static constexpr size_t pass_count(std::ptrdiff_t)
+    {
+        return 0;
+    }
 };
 template<size_t I, typename Tuple>
 struct TupleRadixSorter<I, I, const Tuple &>
 {
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It, It, OutIt, OutIt, ExtractKey &&)
+    static bool sort(It, It, OutIt, OutIt, ExtractKey &&, const RadixSortSettings &)
     {
         return false;
     }
 
-    static constexpr size_t pass_count = 0;
+    static constexpr size_t pass_count(std::ptrdiff_t)
+    {
+        return 0;
+    }
 };
 
 template<typename... Args>
@@ -602,12 +1138,15 @@ struct RadixSorter<std::tuple<Args...>>
     using SorterImpl = TupleRadixSorter<0, sizeof...(Args), std::tuple<Args...>>;
 
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
+    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings)
     {
-        return SorterImpl::sort(begin, end, buffer_begin, buffer_begin + (end - begin), extract_key);
+        return SorterImpl::sort(begin, end, buffer_begin, buffer_begin + (end - begin), extract_key, settings);
     }
 
-    static constexpr size_t pass_count = SorterImpl::pass_count;
+    static constexpr size_t pass_count(std::ptrdiff_t num_elements)
+    {
+        return SorterImpl::pass_count(num_elements);
+    }
 };
 
 template<typename... Args>
@@ -616,19 +1155,22 @@ struct RadixSorter<const std::tuple<Args...> &>
     using SorterImpl = TupleRadixSorter<0, sizeof...(Args), const std::tuple<Args...> &>;
 
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
+    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings)
     {
-        return SorterImpl::sort(begin, end, buffer_begin, buffer_begin + (end - begin), extract_key);
+        return SorterImpl::sort(begin, end, buffer_begin, buffer_begin + (end - begin), extract_key, settings);
     }
 
-    static constexpr size_t pass_count = SorterImpl::pass_count;
+    static constexpr size_t pass_count(std::ptrdiff_t num_elements)
+    {
+        return SorterImpl::pass_count(num_elements);
+    }
 };
 
 template<typename T, size_t S>
 struct RadixSorter<std::array<T, S>>
 {
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
+    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings)
     {
         auto buffer_end = buffer_begin + (end - begin);
         bool which = false;
@@ -639,14 +1181,73 @@ struct RadixSorter<std::array<T, S>>
                 return extract_key(o)[i];
             };
             if (which)
-                which = !RadixSorter<T>::sort(buffer_begin, buffer_end, begin, extract_i);
+                which = !RadixSorter<T>::sort(buffer_begin, buffer_end, begin, extract_i, settings);
             else
-                which = RadixSorter<T>::sort(begin, end, buffer_begin, extract_i);
+                which = RadixSorter<T>::sort(begin, end, buffer_begin, extract_i, settings);
         }
         return which;
     }
 
-    static constexpr size_t pass_count = RadixSorter<T>::pass_count * S;
+    static constexpr size_t pass_count(std::ptrdiff_t num_elements)
+    {
+        return RadixSorter<T>::pass_count(num_elements) * S;
+    }
+};
+
+// sorts the chunks of a byte array from the last to the first
+template<size_t Size, size_t Offset = 0>
+struct ByteArrayRadixSorter
+{
+    using Chunk = ByteArrayChunk<Size, Offset>;
+    using ThisSorter = SizedRadixSorter<sizeof(typename Chunk::type)>;
+    using NextSorter = ByteArrayRadixSorter<Size, Offset + Chunk::num_bytes>;
+
+    template<typename It, typename OutIt, typename ExtractKey>
+    static bool sort(It begin, It end, OutIt out_begin, OutIt out_end, ExtractKey && extract_key, const RadixSortSettings & settings)
+    {
+        bool which = NextSorter::sort(begin, end, out_begin, out_end, extract_key, settings);
+        auto extract_chunk = [&](auto && o)
+        {
+            return Chunk::load(extract_key(o));
+        };
+        if (which)
+            return !ThisSorter::sort(out_begin, out_end, begin, extract_chunk, settings);
+        else
+            return ThisSorter::sort(begin, end, out_begin, extract_chunk, settings);
+    }
+
+    static constexpr size_t pass_count(std::ptrdiff_t num_elements)
+    {
+        return ThisSorter::pass_count(num_elements) + NextSorter::pass_count(num_elements);
+    }
+};
+template<size_t Size>
+struct ByteArrayRadixSorter<Size, Size>
+{
+    template<typename It, typename OutIt, typename ExtractKey>
+    static bool sort(It, It, OutIt, OutIt, ExtractKey &&, const RadixSortSettings &)
+    {
+        return false;
+    }
+
+    static constexpr size_t pass_count(std::ptrdiff_t)
+    {
+        return 0;
+    }
+};
+template<size_t S>
+struct RadixSorter<std::array<unsigned char, S>>
+{
+    template<typename It, typename OutIt, typename ExtractKey>
+    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings)
+    {
+        return ByteArrayRadixSorter<S>::sort(begin, end, buffer_begin, buffer_begin + (end - begin), extract_key, settings);
+    }
+
+    static constexpr size_t pass_count(std::ptrdiff_t num_elements)
+    {
+        return ByteArrayRadixSorter<S>::pass_count(num_elements);
+    }
 };
 
 template<typename T>
@@ -685,12 +1286,12 @@ struct FallbackRadixSorter : RadixSorter<decltype(to_radix_sort_key(std::declval
     using base = RadixSorter<decltype(to_radix_sort_key(std::declval<T>()))>;
 
     template<typename It, typename OutIt, typename ExtractKey>
-    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
+    static bool sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings)
     {
         return base::sort(begin, end, buffer_begin, [&](auto && a) -> decltype(auto)
         {
             return to_radix_sort_key(extract_key(a));
-        });
+        }, settings);
     }
 };
 
@@ -730,7 +1331,18 @@ struct RadixSorter : FallbackRadixSorter<T>
 };
 
 template<typename T>
-size_t radix_sort_pass_count = RadixSorter<T>::pass_count;
+constexpr size_t radix_sort_pass_count(std::ptrdiff_t num_elements)
+{
+    return RadixSorter<T>::pass_count(num_elements);
+}
+// ska_sort_copy falls back to ska_sort when this is 8 or more. wider digits
+// save passes, but not enough to make LSD sorting win for keys of eight
+// bytes or more, so this counts the passes with byte sized digits
+template<typename T>
+constexpr size_t radix_sort_byte_pass_count()
+{
+    return RadixSorter<T>::pass_count(0);
+}
 
 template<typename It, typename Func>
 inline void unroll_loop_four_times(It begin, size_t iteration_count, Func && to_call)
@@ -798,28 +1410,6 @@ struct PartitionInfo
     size_t next_offset;
 };
 
-template<size_t>
-struct UnsignedForSize;
-template<>
-struct UnsignedForSize<1>
-{
-    typedef uint8_t type;
-};
-template<>
-struct UnsignedForSize<2>
-{
-    typedef uint16_t type;
-};
-template<>
-struct UnsignedForSize<4>
-{
-    typedef uint32_t type;
-};
-template<>
-struct UnsignedForSize<8>
-{
-    typedef uint64_t type;
-};
 template<typename T>
 struct SubKey;
 template<size_t Size>
@@ -915,6 +1505,31 @@ template<typename T>
 struct SubKey<T *> : SizedSubKey<sizeof(T *)>
 {
 };
+#ifdef SKA_SORT_INT128
+template<>
+struct SubKey<unsigned __int128> : SizedSubKey<sizeof(unsigned __int128)>
+{
+};
+#endif
+template<size_t Size, size_t Offset>
+struct ByteArraySubKey
+{
+    using Chunk = ByteArrayChunk<Size, Offset>;
+
+    template<typename T>
+    static typename Chunk::type sub_key(T && value, void *)
+    {
+        return Chunk::load(value);
+    }
+
+    using next = typename std::conditional<Offset + Chunk::num_bytes == Size, SubKey<void>, ByteArraySubKey<Size, Offset + Chunk::num_bytes>>::type;
+
+    using sub_key_type = typename Chunk::type;
+};
+template<size_t Size>
+struct SubKey<std::array<unsigned char, Size>> : ByteArraySubKey<Size, 0>
+{
+};
 template<typename F, typename S, typename Current>
 struct PairSecondSubKey : Current
 {
@@ -1041,93 +1656,564 @@ struct FallbackSubKey<T, typename std::enable_if<has_subscript_operator<T>::valu
 {
 };
 
-template<typename It, typename ExtractKey>
-inline void StdSortFallback(It begin, It end, ExtractKey & extract_key)
+// tag for a list that gets sorted in descending order
+template<typename T>
+struct DescendingList
 {
-    std::sort(begin, end, [&](auto && l, auto && r){ return extract_key(l) < extract_key(r); });
-}
+};
+template<typename T, typename Enable = void>
+struct DescendingSubKeyType
+{
+    using type = T;
+};
+template<typename T>
+struct DescendingSubKeyType<T, typename std::enable_if<has_subscript_operator<T>::value>::type>
+{
+    using type = DescendingList<T>;
+};
+template<typename T>
+struct DescendingSubKeyType<DescendingList<T>>
+{
+    using type = T;
+};
 
-template<std::ptrdiff_t StdSortThreshold, typename It, typename ExtractKey>
-inline bool StdSortIfLessThanThreshold(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key)
+template<typename Current>
+struct DescendingSubKey : Current
 {
-    if (num_elements <= 1)
-        return true;
-    if (num_elements >= StdSortThreshold)
-        return false;
-    StdSortFallback(begin, end, extract_key);
-    return true;
-}
+    template<typename U>
+    static decltype(auto) sub_key(U && value, void * data)
+    {
+        return invert_sub_key(Current::sub_key(value, data));
+    }
 
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey, typename SubKeyType = typename CurrentSubKey::sub_key_type>
-struct InplaceSorter;
+    using next = typename std::conditional<std::is_same<SubKey<void>, typename Current::next>::value, SubKey<void>, DescendingSubKey<typename Current::next>>::type;
 
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey, size_t NumBytes, size_t Offset = 0>
-struct UnsignedInplaceSorter
+    using sub_key_type = typename DescendingSubKeyType<typename Current::sub_key_type>::type;
+};
+// unwraps a descending_key. the keys are inverted by DescendingSubKey
+template<typename Current>
+struct DescendingValueSubKey : Current
 {
-    static constexpr size_t ShiftAmount = (((NumBytes - 1) - Offset) * 8);
-    template<typename T>
-    inline static uint8_t current_byte(T && elem, void * sort_data)
+    template<typename U>
+    static decltype(auto) sub_key(U && value, void * data)
     {
-        return CurrentSubKey::sub_key(elem, sort_data) >> ShiftAmount;
+        return Current::sub_key(value.value, data);
     }
-    template<typename It, typename ExtractKey>
-    static void sort(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * sort_data)
+
+    using next = typename std::conditional<std::is_same<SubKey<void>, typename Current::next>::value, SubKey<void>, DescendingValueSubKey<typename Current::next>>::type;
+};
+template<typename T>
+struct SubKey<descending_key<T>> : DescendingSubKey<DescendingValueSubKey<SubKey<T>>>
+{
+};
+
+// compares two keys in the order that the radix sort puts them in. that is
+// not the same as operator< for NaNs, and it also works for keys that only
+// provide to_radix_sort_key. keys that neither sort knows how to take apart
+// fall back to operator<
+template<typename T, typename Enable = void>
+struct RadixLess;
+template<typename T, typename Enable = void>
+struct FallbackRadixLess
+{
+    static bool less(const T & l, const T & r)
     {
-        if (num_elements < AmericanFlagSortThreshold)
-            american_flag_sort(begin, end, extract_key, next_sort, sort_data);
-        else
-            ska_byte_sort(begin, end, extract_key, next_sort, sort_data);
+        return l < r;
     }
-
-    template<typename It, typename ExtractKey>
-    static void american_flag_sort(It begin, It end, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * sort_data)
+};
+template<typename T>
+struct FallbackRadixLess<T, void_t<decltype(to_radix_sort_key(std::declval<T>()))>>
+{
+    static bool less(const T & l, const T & r)
     {
-        PartitionInfo partitions[256];
-        for (It it = begin; it != end; ++it)
+        using key_type = typename std::decay<decltype(to_radix_sort_key(l))>::type;
+        return RadixLess<key_type>::less(to_radix_sort_key(l), to_radix_sort_key(r));
+    }
+};
+template<typename T, typename Enable = void>
+struct is_byte_list : std::false_type
+{
+};
+template<typename T>
+struct is_byte_list<T, void_t<decltype(std::declval<const T &>().data())>>
+    : std::integral_constant<bool, std::is_same<decltype(std::declval<const T &>().data()), const char *>::value
+                                   || std::is_same<decltype(std::declval<const T &>().data()), const unsigned char *>::value>
+{
+};
+template<typename T, typename Enable = void>
+struct ListRadixLess
+{
+    static bool less(const T & l, const T & r)
+    {
+        using element_type = typename std::decay<decltype(l[0])>::type;
+        size_t l_size = l.size();
+        size_t r_size = r.size();
+        for (size_t i = 0, end = std::min(l_size, r_size); i < end; ++i)
         {
-            ++partitions[current_byte(extract_key(*it), sort_data)].count;
+            if (RadixLess<element_type>::less(l[i], r[i]))
+                return true;
+            if (RadixLess<element_type>::less(r[i], l[i]))
+                return false;
         }
-        size_t total = 0;
-        uint8_t remaining_partitions[256];
-        int num_partitions = 0;
-        for (int i = 0; i < 256; ++i)
+        return l_size < r_size;
+    }
+};
+// bytes are compared as unsigned chars, so memcmp gives the same order
+template<typename T>
+struct ListRadixLess<T, typename std::enable_if<is_byte_list<T>::value>::type>
+{
+    static bool less(const T & l, const T & r)
+    {
+        size_t l_size = l.size();
+        size_t r_size = r.size();
+        size_t common = std::min(l_size, r_size);
+        if (common)
         {
-            size_t count = partitions[i].count;
-            if (!count)
-                continue;
-            partitions[i].offset = total;
-            total += count;
-            partitions[i].next_offset = total;
-            remaining_partitions[num_partitions] = i;
-            ++num_partitions;
+            int compared = std::memcmp(l.data(), r.data(), common);
+            if (compared)
+                return compared < 0;
         }
-        if (num_partitions > 1)
-        {
-            uint8_t * current_block_ptr = remaining_partitions;
-            PartitionInfo * current_block = partitions + *current_block_ptr;
-            uint8_t * last_block = remaining_partitions + num_partitions - 1;
-            It it = begin;
-            It block_end = begin + current_block->next_offset;
-            It last_element = end - 1;
-            for (;;)
-            {
-                PartitionInfo * block = partitions + current_byte(extract_key(*it), sort_data);
-                if (block == current_block)
-                {
-                    ++it;
-                    if (it == last_element)
-                        break;
-                    else if (it == block_end)
-                    {
-                        for (;;)
-                        {
-                            ++current_block_ptr;
-                            if (current_block_ptr == last_block)
-                                goto recurse;
-                            current_block = partitions + *current_block_ptr;
-                            if (current_block->offset != current_block->next_offset)
-                                break;
-                        }
+        return l_size < r_size;
+    }
+};
+template<typename T>
+struct FallbackRadixLess<T, typename std::enable_if<has_subscript_operator<T>::value>::type> : ListRadixLess<T>
+{
+};
+template<typename T>
+struct FallbackRadixLess<descending_key<T>>
+{
+    static bool less(const descending_key<T> & l, const descending_key<T> & r)
+    {
+        return RadixLess<typename std::decay<T>::type>::less(r.value, l.value);
+    }
+};
+template<typename T, typename Enable>
+struct RadixLess : FallbackRadixLess<T>
+{
+};
+template<typename T>
+struct RadixLess<T, void_t<decltype(to_unsigned_or_bool(std::declval<T>()))>>
+{
+    static bool less(const T & l, const T & r)
+    {
+        return to_unsigned_or_bool(l) < to_unsigned_or_bool(r);
+    }
+};
+template<typename F, typename S>
+struct RadixLess<std::pair<F, S>>
+{
+    static bool less(const std::pair<F, S> & l, const std::pair<F, S> & r)
+    {
+        using first_type = typename std::decay<F>::type;
+        if (RadixLess<first_type>::less(l.first, r.first))
+            return true;
+        if (RadixLess<first_type>::less(r.first, l.first))
+            return false;
+        return RadixLess<typename std::decay<S>::type>::less(l.second, r.second);
+    }
+};
+template<size_t Index, size_t Size>
+struct TupleRadixLess
+{
+    template<typename Tuple>
+    static bool less(const Tuple & l, const Tuple & r)
+    {
+        using element_type = typename std::decay<typename std::tuple_element<Index, Tuple>::type>::type;
+        if (RadixLess<element_type>::less(std::get<Index>(l), std::get<Index>(r)))
+            return true;
+        if (RadixLess<element_type>::less(std::get<Index>(r), std::get<Index>(l)))
+            return false;
+        return TupleRadixLess<Index + 1, Size>::less(l, r);
+    }
+};
+template<size_t Size>
+struct TupleRadixLess<Size, Size>
+{
+    template<typename Tuple>
+    static bool less(const Tuple &, const Tuple &)
+    {
+        return false;
+    }
+};
+template<typename... T>
+struct RadixLess<std::tuple<T...>>
+{
+    static bool less(const std::tuple<T...> & l, const std::tuple<T...> & r)
+    {
+        return TupleRadixLess<0, sizeof...(T)>::less(l, r);
+    }
+};
+// the two keys can have different types when one of them is a proxy, like
+// the elements of a std::vector<bool> and of a std::deque<bool>
+template<typename L, typename R>
+inline bool radix_less(const L & l, const R & r)
+{
+    return RadixLess<typename std::common_type<L, R>::type>::less(l, r);
+}
+
+template<typename It, typename ExtractKey>
+inline void StdSortFallback(It begin, It end, ExtractKey & extract_key)
+{
+    std::sort(begin, end, [&](auto && l, auto && r){ return extract_key(l) < extract_key(r); });
+}
+
+// the small sort caches keys in arrays on the stack, which limits how many
+// elements it can handle
+static constexpr std::ptrdiff_t SmallSortMaxElements = 256;
+
+// moves the element at begin[sources[i]] to begin[i] for every i, following
+// the cycles of the permutation so that every element moves only once.
+// overwrites sources
+template<typename It, typename Index>
+void apply_permutation(It begin, Index * sources, std::ptrdiff_t num_elements)
+{
+    for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+    {
+        if (sources[i] == static_cast<Index>(i))
+            continue;
+        typename std::iterator_traits<It>::value_type first = std::move(begin[i]);
+        std::ptrdiff_t current = i;
+        for (;;)
+        {
+            std::ptrdiff_t source = sources[current];
+            sources[current] = static_cast<Index>(current);
+            if (source == i)
+            {
+                begin[current] = std::move(first);
+                break;
+            }
+            begin[current] = std::move(begin[source]);
+            current = source;
+        }
+    }
+}
+
+inline void compare_exchange(std::uint64_t & a, std::uint64_t & b)
+{
+    std::uint64_t min = a < b ? a : b;
+    std::uint64_t max = a < b ? b : a;
+    a = min;
+    b = max;
+}
+// a bitonic sorting network. all compare_exchanges are independent within a
+// step and have no branches, so the compiler can unroll and vectorize them
+template<size_t Size>
+void sorting_network(std::uint64_t * values)
+{
+    for (size_t k = 2; k <= Size; k *= 2)
+    {
+        for (size_t j = k / 2; j > 0; j /= 2)
+        {
+            for (size_t i = 0; i < Size; ++i)
+            {
+                size_t partner = i ^ j;
+                if (partner <= i)
+                    continue;
+                if (i & k)
+                    compare_exchange(values[partner], values[i]);
+                else
+                    compare_exchange(values[i], values[partner]);
+            }
+        }
+    }
+}
+// sorts num_elements values. up to 16 values get padded to the size of the
+// next sorting network
+inline void sort_packed_keys(std::uint64_t * values, std::ptrdiff_t num_elements)
+{
+    auto pad_to = [&](std::ptrdiff_t size)
+    {
+        std::fill(values + num_elements, values + size, std::numeric_limits<std::uint64_t>::max());
+    };
+    if (num_elements <= 4)
+    {
+        pad_to(4);
+        sorting_network<4>(values);
+    }
+    else if (num_elements <= 8)
+    {
+        pad_to(8);
+        sorting_network<8>(values);
+    }
+    else if (num_elements <= 16)
+    {
+        pad_to(16);
+        sorting_network<16>(values);
+    }
+    else if (num_elements <= 32)
+    {
+        // padding this up to the next network costs more than it saves
+        for (std::ptrdiff_t i = 1; i < num_elements; ++i)
+        {
+            std::uint64_t value = values[i];
+            std::ptrdiff_t j = i;
+            for (; j > 0 && value < values[j - 1]; --j)
+                values[j] = values[j - 1];
+            values[j] = value;
+        }
+    }
+    else
+        std::sort(values, values + num_elements);
+}
+
+// for keys of up to four bytes, the key and the index of the element get
+// packed into one integer, and sorting those is enough
+template<typename It, typename ExtractKey>
+void small_sort_packed(It begin, std::ptrdiff_t num_elements, ExtractKey & extract_key)
+{
+    std::uint64_t packed[SmallSortMaxElements];
+    for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+        packed[i] = (static_cast<std::uint64_t>(to_unsigned_or_bool(extract_key(begin[i]))) << 32) | static_cast<std::uint64_t>(i);
+    sort_packed_keys(packed, num_elements);
+    std::uint32_t sources[SmallSortMaxElements];
+    for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+        sources[i] = static_cast<std::uint32_t>(packed[i]);
+    apply_permutation(begin, sources, num_elements);
+}
+template<typename It, typename ExtractKey>
+void small_sort_key_index(It begin, std::ptrdiff_t num_elements, ExtractKey & extract_key)
+{
+    using key_type = decltype(to_unsigned_or_bool(extract_key(*begin)));
+    std::pair<key_type, std::uint32_t> keys[SmallSortMaxElements];
+    for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+        keys[i] = { to_unsigned_or_bool(extract_key(begin[i])), static_cast<std::uint32_t>(i) };
+    std::sort(keys, keys + num_elements);
+    std::uint32_t sources[SmallSortMaxElements];
+    for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+        sources[i] = keys[i].second;
+    apply_permutation(begin, sources, num_elements);
+}
+
+// holds the result of extract_key for every element of a small range.
+// references get stored as pointers, values get copied
+template<typename KeyResult>
+struct CachedKeys
+{
+    using key_type = typename std::decay<KeyResult>::type;
+    typename std::aligned_storage<sizeof(key_type), alignof(key_type)>::type storage[SmallSortMaxElements];
+    std::ptrdiff_t size = 0;
+
+    template<typename T>
+    void push_back(T && key)
+    {
+        ::new (static_cast<void *>(storage + size)) key_type(std::forward<T>(key));
+        ++size;
+    }
+    const key_type & operator[](std::uint32_t index) const
+    {
+        return *reinterpret_cast<const key_type *>(storage + index);
+    }
+    ~CachedKeys()
+    {
+        for (std::ptrdiff_t i = 0; i < size; ++i)
+            reinterpret_cast<key_type *>(storage + i)->~key_type();
+    }
+};
+template<typename KeyResult>
+struct CachedKeys<KeyResult &>
+{
+    using key_type = typename std::remove_reference<KeyResult>::type;
+    const key_type * pointers[SmallSortMaxElements];
+    std::ptrdiff_t size = 0;
+
+    void push_back(const key_type & key)
+    {
+        pointers[size++] = std::addressof(key);
+    }
+    const key_type & operator[](std::uint32_t index) const
+    {
+        return *pointers[index];
+    }
+};
+// an rvalue reference may point to a temporary, so those get copied
+template<typename KeyResult>
+struct CachedKeys<KeyResult &&> : CachedKeys<KeyResult>
+{
+};
+
+// sorts the indices of the elements by their cached keys, so that only four
+// bytes get moved around for every swap
+template<typename It, typename ExtractKey>
+void small_sort_indirect(It begin, std::ptrdiff_t num_elements, ExtractKey & extract_key)
+{
+    CachedKeys<decltype(extract_key(*begin))> keys;
+    std::uint32_t order[SmallSortMaxElements];
+    for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+    {
+        keys.push_back(extract_key(begin[i]));
+        order[i] = static_cast<std::uint32_t>(i);
+    }
+    auto compare = [&](std::uint32_t l, std::uint32_t r)
+    {
+        return keys[l] < keys[r];
+    };
+    if (num_elements <= 32)
+    {
+        for (std::ptrdiff_t i = 1; i < num_elements; ++i)
+        {
+            std::uint32_t index = order[i];
+            std::ptrdiff_t j = i;
+            for (; j > 0 && compare(index, order[j - 1]); --j)
+                order[j] = order[j - 1];
+            order[j] = index;
+        }
+    }
+    else
+        std::sort(order, order + num_elements, compare);
+    apply_permutation(begin, order, num_elements);
+}
+
+template<typename KeyType, typename Enable = void>
+struct CachedKeySmallSort
+{
+    template<typename It, typename ExtractKey>
+    static void sort(It begin, It end, ExtractKey & extract_key)
+    {
+        std::ptrdiff_t num_elements = end - begin;
+        // big keys that have to be copied would take too much stack space
+        bool too_big = !std::is_lvalue_reference<decltype(extract_key(*begin))>::value && sizeof(KeyType) > 64;
+        if (num_elements > SmallSortMaxElements || too_big)
+            StdSortFallback(begin, end, extract_key);
+        else
+            small_sort_indirect(begin, num_elements, extract_key);
+    }
+};
+template<typename KeyType>
+struct CachedKeySmallSort<KeyType, typename std::enable_if<std::is_arithmetic<KeyType>::value>::type>
+{
+    template<typename It, typename ExtractKey>
+    static void sort(It begin, It end, ExtractKey & extract_key)
+    {
+        std::ptrdiff_t num_elements = end - begin;
+        if (num_elements > SmallSortMaxElements)
+            StdSortFallback(begin, end, extract_key);
+        else if (sizeof(KeyType) <= 4)
+            small_sort_packed(begin, num_elements, extract_key);
+        else
+            small_sort_key_index(begin, num_elements, extract_key);
+    }
+};
+
+template<typename Policy, typename It, typename ExtractKey>
+inline bool StdSortIfLessThanThreshold(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key)
+{
+    if (num_elements <= 1)
+        return true;
+    if (num_elements >= Policy::std_sort_threshold)
+        return false;
+    Policy::small_sort::sort(begin, end, extract_key);
+    return true;
+}
+
+template<typename Policy, typename CurrentSubKey, typename SubKeyType = typename CurrentSubKey::sub_key_type>
+struct InplaceSorter;
+
+// the index of the first byte at or after start_byte, counting from the most
+// significant one, that has a bit set in difference. NumBytes if there is
+// none
+template<size_t NumBytes, typename T>
+inline size_t first_differing_byte(T difference, size_t start_byte)
+{
+    size_t byte = start_byte;
+    while (byte < NumBytes && !static_cast<uint8_t>(difference >> ((NumBytes - 1 - byte) * 8)))
+        ++byte;
+    return byte;
+}
+
+// sorts starting at a byte that is only known at runtime, which has to be at
+// least Offset
+template<typename Policy, typename CurrentSubKey, size_t NumBytes, size_t Offset, typename Enable = void>
+struct SortFromByte;
+
+template<typename Policy, typename CurrentSubKey, size_t NumBytes, size_t Offset = 0>
+struct UnsignedInplaceSorter
+{
+    static constexpr size_t ShiftAmount = (((NumBytes - 1) - Offset) * 8);
+    template<typename T>
+    inline static uint8_t current_byte(T && elem, void * sort_data)
+    {
+        return CurrentSubKey::sub_key(elem, sort_data) >> ShiftAmount;
+    }
+    template<typename It, typename ExtractKey>
+    static void sort(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * sort_data)
+    {
+        if (num_elements < Policy::american_flag_sort_threshold)
+            american_flag_sort(begin, end, extract_key, next_sort, sort_data);
+        else
+            ska_byte_sort(begin, end, extract_key, next_sort, sort_data);
+    }
+
+    // all elements have the same byte at Offset. instead of another counting
+    // pass for the next byte, this uses the bits that differ between any of
+    // the keys to go straight to the first byte that isn't the same for all
+    template<typename It, typename ExtractKey, typename T>
+    static void skip_shared_bytes(It begin, It end, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * sort_data, T differing_bits)
+    {
+        size_t next_byte = first_differing_byte<NumBytes>(differing_bits, Offset + 1);
+        SortFromByte<Policy, CurrentSubKey, NumBytes, Offset + 1>::sort(next_byte, begin, end, end - begin, extract_key, next_sort, sort_data);
+    }
+
+    template<typename It, typename ExtractKey>
+    static void american_flag_sort(It begin, It end, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * sort_data)
+    {
+        PartitionInfo partitions[256];
+        using key_type = typename std::decay<decltype(CurrentSubKey::sub_key(extract_key(*begin), sort_data))>::type;
+        key_type bits_in_all = static_cast<key_type>(~key_type());
+        key_type bits_in_any = key_type();
+        for (It it = begin; it != end; ++it)
+        {
+            key_type key = CurrentSubKey::sub_key(extract_key(*it), sort_data);
+            ++partitions[static_cast<uint8_t>(key >> ShiftAmount)].count;
+            bits_in_all &= key;
+            bits_in_any |= key;
+        }
+        size_t total = 0;
+        uint8_t remaining_partitions[256];
+        int num_partitions = 0;
+        for (int i = 0; i < 256; ++i)
+        {
+            size_t count = partitions[i].count;
+            if (!count)
+                continue;
+            partitions[i].offset = total;
+            total += count;
+            partitions[i].next_offset = total;
+            remaining_partitions[num_partitions] = i;
+            ++num_partitions;
+        }
+        if (num_partitions == 1)
+        {
+            skip_shared_bytes(begin, end, extract_key, next_sort, sort_data, bits_in_all ^ bits_in_any);
+            return;
+        }
+        if (num_partitions > 1)
+        {
+            uint8_t * current_block_ptr = remaining_partitions;
+            PartitionInfo * current_block = partitions + *current_block_ptr;
+            uint8_t * last_block = remaining_partitions + num_partitions - 1;
+            It it = begin;
+            It block_end = begin + current_block->next_offset;
+            It last_element = end - 1;
+            for (;;)
+            {
+                PartitionInfo * block = partitions + current_byte(extract_key(*it), sort_data);
+                if (block == current_block)
+                {
+                    ++it;
+                    if (it == last_element)
+                        break;
+                    else if (it == block_end)
+                    {
+                        for (;;)
+                        {
+                            ++current_block_ptr;
+                            if (current_block_ptr == last_block)
+                                goto recurse;
+                            current_block = partitions + *current_block_ptr;
+                            if (current_block->offset != current_block->next_offset)
+                                break;
+                        }
 
                         it = begin + current_block->offset;
                         block_end = begin + current_block->next_offset;
@@ -1150,9 +2236,9 @@ struct UnsignedInplaceSorter
                 size_t end_offset = partitions[*it].next_offset;
                 It partition_end = begin + end_offset;
                 std::ptrdiff_t num_elements = end_offset - start_offset;
-                if (!StdSortIfLessThanThreshold<StdSortThreshold>(partition_begin, partition_end, num_elements, extract_key))
+                if (!StdSortIfLessThanThreshold<Policy>(partition_begin, partition_end, num_elements, extract_key))
                 {
-                    UnsignedInplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, NumBytes, Offset + 1>::sort(partition_begin, partition_end, num_elements, extract_key, next_sort, sort_data);
+                    UnsignedInplaceSorter<Policy, CurrentSubKey, NumBytes, Offset + 1>::sort(partition_begin, partition_end, num_elements, extract_key, next_sort, sort_data);
                 }
                 start_offset = end_offset;
                 partition_begin = partition_end;
@@ -1161,263 +2247,1334 @@ struct UnsignedInplaceSorter
     }
 
     template<typename It, typename ExtractKey>
-    static void ska_byte_sort(It begin, It end, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * sort_data)
+    static void ska_byte_sort(It begin, It end, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * sort_data)
+    {
+        PartitionInfo partitions[256];
+        using key_type = typename std::decay<decltype(CurrentSubKey::sub_key(extract_key(*begin), sort_data))>::type;
+        key_type bits_in_all = static_cast<key_type>(~key_type());
+        key_type bits_in_any = key_type();
+        for (It it = begin; it != end; ++it)
+        {
+            key_type key = CurrentSubKey::sub_key(extract_key(*it), sort_data);
+            ++partitions[static_cast<uint8_t>(key >> ShiftAmount)].count;
+            bits_in_all &= key;
+            bits_in_any |= key;
+        }
+        uint8_t remaining_partitions[256];
+        size_t total = 0;
+        int num_partitions = 0;
+        for (int i = 0; i < 256; ++i)
+        {
+            size_t count = partitions[i].count;
+            if (count)
+            {
+                partitions[i].offset = total;
+                total += count;
+                remaining_partitions[num_partitions] = i;
+                ++num_partitions;
+            }
+            partitions[i].next_offset = total;
+        }
+        if (num_partitions == 1)
+        {
+            skip_shared_bytes(begin, end, extract_key, next_sort, sort_data, bits_in_all ^ bits_in_any);
+            return;
+        }
+        for (uint8_t * last_remaining = remaining_partitions + num_partitions, * end_partition = remaining_partitions + 1; last_remaining > end_partition;)
+        {
+            last_remaining = custom_std_partition(remaining_partitions, last_remaining, [&](uint8_t partition)
+            {
+                size_t & begin_offset = partitions[partition].offset;
+                size_t & end_offset = partitions[partition].next_offset;
+                if (begin_offset == end_offset)
+                    return false;
+
+                unroll_loop_four_times(begin + begin_offset, end_offset - begin_offset, [partitions = partitions, begin, &extract_key, sort_data](It it)
+                {
+                    uint8_t this_partition = current_byte(extract_key(*it), sort_data);
+                    size_t offset = partitions[this_partition].offset++;
+                    std::iter_swap(it, begin + offset);
+                });
+                return begin_offset != end_offset;
+            });
+        }
+        if (Offset + 1 != NumBytes || next_sort)
+        {
+            for (uint8_t * it = remaining_partitions + num_partitions; it != remaining_partitions; --it)
+            {
+                uint8_t partition = it[-1];
+                size_t start_offset = (partition == 0 ? 0 : partitions[partition - 1].next_offset);
+                size_t end_offset = partitions[partition].next_offset;
+                It partition_begin = begin + start_offset;
+                It partition_end = begin + end_offset;
+                std::ptrdiff_t num_elements = end_offset - start_offset;
+                if (!StdSortIfLessThanThreshold<Policy>(partition_begin, partition_end, num_elements, extract_key))
+                {
+                    UnsignedInplaceSorter<Policy, CurrentSubKey, NumBytes, Offset + 1>::sort(partition_begin, partition_end, num_elements, extract_key, next_sort, sort_data);
+                }
+            }
+        }
+    }
+};
+
+template<typename Policy, typename CurrentSubKey, size_t NumBytes>
+struct UnsignedInplaceSorter<Policy, CurrentSubKey, NumBytes, NumBytes>
+{
+    template<typename It, typename ExtractKey>
+    inline static void sort(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * next_sort_data)
+    {
+        next_sort(begin, end, num_elements, extract_key, next_sort_data);
+    }
+};
+
+template<typename Policy, typename CurrentSubKey, size_t NumBytes, size_t Offset>
+struct SortFromByte<Policy, CurrentSubKey, NumBytes, Offset, typename std::enable_if<Offset != NumBytes>::type>
+{
+    template<typename It, typename ExtractKey>
+    static void sort(size_t byte, It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * sort_data)
+    {
+        if (byte == Offset)
+            UnsignedInplaceSorter<Policy, CurrentSubKey, NumBytes, Offset>::sort(begin, end, num_elements, extract_key, next_sort, sort_data);
+        else
+            SortFromByte<Policy, CurrentSubKey, NumBytes, Offset + 1>::sort(byte, begin, end, num_elements, extract_key, next_sort, sort_data);
+    }
+};
+// all keys are the same
+template<typename Policy, typename CurrentSubKey, size_t NumBytes>
+struct SortFromByte<Policy, CurrentSubKey, NumBytes, NumBytes>
+{
+    template<typename It, typename ExtractKey>
+    static void sort(size_t, It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * sort_data)
+    {
+        if (next_sort)
+            next_sort(begin, end, num_elements, extract_key, sort_data);
+    }
+};
+
+// the number of equal elements at the start of lhs and rhs. compares 32 or
+// 16 bytes at a time where the instructions for that are available, else
+// eight. the last few bytes and the block with the difference get compared
+// one byte at a time
+template<typename T>
+size_t count_equal_elements(const T * lhs, const T * rhs, size_t size)
+{
+    const unsigned char * lhs_bytes = reinterpret_cast<const unsigned char *>(lhs);
+    const unsigned char * rhs_bytes = reinterpret_cast<const unsigned char *>(rhs);
+    size_t num_bytes = size * sizeof(T);
+    size_t i = 0;
+#ifdef SKA_SORT_AVX2
+    for (; i + 32 <= num_bytes; i += 32)
+    {
+        __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lhs_bytes + i));
+        __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs_bytes + i));
+        if (static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(l, r))) != 0xffffffffu)
+            break;
+    }
+#endif
+#ifdef SKA_SORT_SSE2
+    for (; i + 16 <= num_bytes; i += 16)
+    {
+        __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lhs_bytes + i));
+        __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rhs_bytes + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(l, r)) != 0xffff)
+            break;
+    }
+#else
+    for (; i + 8 <= num_bytes; i += 8)
+    {
+        std::uint64_t l;
+        std::uint64_t r;
+        std::memcpy(&l, lhs_bytes + i, 8);
+        std::memcpy(&r, rhs_bytes + i, 8);
+        if (l != r)
+            break;
+    }
+#endif
+    for (; i < num_bytes; ++i)
+    {
+        if (lhs_bytes[i] != rhs_bytes[i])
+            break;
+    }
+    return i / sizeof(T);
+}
+// the first index in [begin_index, end_index) at which the lists differ.
+// lists that store integers next to each other get compared as bytes,
+// because for integers the keys are equal exactly when the bytes are
+template<typename List, typename Enable = void>
+struct ListMismatch
+{
+    template<typename ElementKey>
+    static size_t find(const List & lhs, const List & rhs, size_t begin_index, size_t end_index, ElementKey & element_key)
+    {
+        for (size_t i = begin_index; i < end_index; ++i)
+        {
+            if (element_key(lhs[i]) != element_key(rhs[i]))
+                return i;
+        }
+        return end_index;
+    }
+};
+template<typename List>
+struct ListMismatch<List, typename std::enable_if<std::is_integral<typename std::remove_cv<typename std::remove_pointer<decltype(std::declval<const List &>().data())>::type>::type>::value>::type>
+{
+    template<typename ElementKey>
+    static size_t find(const List & lhs, const List & rhs, size_t begin_index, size_t end_index, ElementKey &)
+    {
+        return begin_index + count_equal_elements(lhs.data() + begin_index, rhs.data() + begin_index, end_index - begin_index);
+    }
+};
+
+template<typename It, typename ExtractKey, typename ElementKey>
+size_t CommonPrefix(It begin, It end, size_t start_index, ExtractKey && extract_key, ElementKey && element_key)
+{
+    const auto & largest_match_list = extract_key(*begin);
+    size_t largest_match = largest_match_list.size();
+    if (largest_match == start_index)
+        return start_index;
+    for (++begin; begin != end; ++begin)
+    {
+        const auto & current_list = extract_key(*begin);
+        size_t current_size = current_list.size();
+        if (current_size < largest_match)
+        {
+            largest_match = current_size;
+            if (largest_match == start_index)
+                return start_index;
+        }
+        if (element_key(largest_match_list[start_index]) != element_key(current_list[start_index]))
+            return start_index;
+        using list_type = typename std::decay<decltype(largest_match_list)>::type;
+        largest_match = ListMismatch<list_type>::find(largest_match_list, current_list, start_index + 1, largest_match, element_key);
+    }
+    return largest_match;
+}
+
+template<typename Policy, typename It, typename ExtractKey>
+void inplace_radix_sort(It begin, It end, ExtractKey & extract_key);
+
+// the next up to eight bytes of a list, starting at some index, packed into
+// one integer, together with how many bytes there were and the position of
+// the element that the list belongs to
+struct CachedListKey
+{
+    std::uint64_t bytes;
+    std::uint32_t index;
+    std::uint8_t num_bytes;
+};
+static constexpr std::ptrdiff_t CachedListKeyMinElements = 4096;
+// sorts lists of bytes, like strings, without reading the lists on every
+// pass: the next eight bytes of every list get copied into an array of
+// CachedListKeys, and only that array gets sorted. lists that are equal in
+// those bytes get their next eight bytes loaded afterwards. at the end every
+// element gets moved to its place once. this is only used for ranges that
+// are big enough for the cache misses to matter
+template<typename Policy, typename CurrentSubKey, typename ListType, typename Enable = void>
+struct CachedListSorter
+{
+    template<typename It, typename ExtractKey, typename SortData>
+    static bool sort(It, It, ExtractKey &, SortData *)
+    {
+        return false;
+    }
+};
+template<typename Policy, typename CurrentSubKey, typename ListType>
+struct CachedListSorter<Policy, CurrentSubKey, ListType, typename std::enable_if<std::is_same<typename ListElementSubKey<CurrentSubKey, ListType>::base::sub_key_type, std::uint8_t>::value>::type>
+{
+    using ElementSubKey = typename ListElementSubKey<CurrentSubKey, ListType>::base;
+
+    template<typename It, typename ExtractKey, typename SortData>
+    static bool sort(It begin, It end, ExtractKey & extract_key, SortData * sort_data)
+    {
+        std::ptrdiff_t num_elements = end - begin;
+        if (num_elements < CachedListKeyMinElements || static_cast<std::uint64_t>(num_elements) > std::numeric_limits<std::uint32_t>::max() || !std::is_reference<decltype(*begin)>::value)
+            return false;
+        void * next_sort_data = sort_data->next_sort_data;
+        auto list_at = [&](std::uint32_t index) -> const ListType &
+        {
+            return CurrentSubKey::sub_key(extract_key(begin[index]), next_sort_data);
+        };
+        size_t start = sort_data->current_index;
+        std::vector<CachedListKey> keys(num_elements);
+        for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+        {
+            keys[i].index = static_cast<std::uint32_t>(i);
+            load(keys[i], list_at(keys[i].index), start);
+        }
+        // ranges of elements with equal lists, for the next sort
+        std::vector<std::pair<std::ptrdiff_t, std::ptrdiff_t>> equal_ranges;
+        sort_keys(keys.data(), keys.data() + num_elements, start, list_at, sort_data->next_sort != nullptr, equal_ranges, keys.data());
+        std::vector<std::uint32_t> sources(num_elements);
+        for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+            sources[i] = keys[i].index;
+        apply_permutation(begin, sources.data(), num_elements);
+        for (const std::pair<std::ptrdiff_t, std::ptrdiff_t> & range : equal_ranges)
+        {
+            It range_begin = begin + range.first;
+            It range_end = begin + range.second;
+            if (!StdSortIfLessThanThreshold<Policy>(range_begin, range_end, range.second - range.first, extract_key))
+                sort_data->next_sort(range_begin, range_end, range.second - range.first, extract_key, next_sort_data);
+        }
+        return true;
+    }
+
+private:
+    static void load(CachedListKey & key, const ListType & list, size_t start)
+    {
+        size_t size = list.size();
+        size_t num_bytes = size > start ? std::min(size - start, size_t(8)) : 0;
+        std::uint64_t bytes = 0;
+        for (size_t i = 0; i < num_bytes; ++i)
+            bytes = (bytes << 8) | ElementSubKey::sub_key(list[start + i], nullptr);
+        key.bytes = num_bytes == 0 ? 0 : bytes << (8 * (8 - num_bytes));
+        key.num_bytes = static_cast<std::uint8_t>(num_bytes);
+    }
+
+    template<typename ListAt>
+    static void sort_keys(CachedListKey * begin, CachedListKey * end, size_t start, ListAt & list_at, bool find_equal_ranges, std::vector<std::pair<std::ptrdiff_t, std::ptrdiff_t>> & equal_ranges, CachedListKey * first)
+    {
+        auto sort_key = [](const CachedListKey & key){ return std::make_pair(key.bytes, key.num_bytes); };
+        inplace_radix_sort<Policy>(begin, end, sort_key);
+        for (CachedListKey * run_begin = begin; run_begin != end;)
+        {
+            CachedListKey * run_end = run_begin + 1;
+            while (run_end != end && run_end->bytes == run_begin->bytes && run_end->num_bytes == run_begin->num_bytes)
+                ++run_end;
+            if (run_end - run_begin > 1)
+            {
+                if (run_begin->num_bytes == 8)
+                {
+                    for (CachedListKey * it = run_begin; it != run_end; ++it)
+                        load(*it, list_at(it->index), start + 8);
+                    sort_keys(run_begin, run_end, start + 8, list_at, find_equal_ranges, equal_ranges, first);
+                }
+                else if (find_equal_ranges)
+                    equal_ranges.emplace_back(run_begin - first, run_end - first);
+            }
+            run_begin = run_end;
+        }
+    }
+};
+
+// in descending order the lists that end first go last, and the elements
+// get compared in descending order
+template<typename Policy, typename CurrentSubKey, typename ListType, bool Descending = false>
+struct ListInplaceSorter
+{
+    using ElementSubKey = typename std::conditional<Descending, DescendingSubKey<ListElementSubKey<CurrentSubKey, ListType>>, ListElementSubKey<CurrentSubKey, ListType>>::type;
+    template<typename It, typename ExtractKey>
+    static void sort(It begin, It end, ExtractKey & extract_key, ListSortData<It, ExtractKey> * sort_data)
+    {
+        if (!Descending && CachedListSorter<Policy, CurrentSubKey, ListType>::sort(begin, end, extract_key, sort_data))
+            return;
+        size_t current_index = sort_data->current_index;
+        void * next_sort_data = sort_data->next_sort_data;
+        auto current_key = [&](auto && elem) -> decltype(auto)
+        {
+            return CurrentSubKey::sub_key(extract_key(elem), next_sort_data);
+        };
+        auto element_key = [&](auto && elem) -> decltype(auto)
+        {
+            return ElementSubKey::base::sub_key(elem, sort_data);
+        };
+        sort_data->current_index = current_index = CommonPrefix(begin, end, current_index, current_key, element_key);
+        It middle = std::partition(begin, end, [&](auto && elem)
+        {
+            return (current_key(elem).size() <= current_index) != Descending;
+        });
+        It shorter_begin = Descending ? middle : begin;
+        It shorter_end = Descending ? end : middle;
+        It longer_begin = Descending ? begin : middle;
+        It longer_end = Descending ? middle : end;
+        std::ptrdiff_t num_shorter_ones = shorter_end - shorter_begin;
+        if (sort_data->next_sort && !StdSortIfLessThanThreshold<Policy>(shorter_begin, shorter_end, num_shorter_ones, extract_key))
+        {
+            sort_data->next_sort(shorter_begin, shorter_end, num_shorter_ones, extract_key, next_sort_data);
+        }
+        std::ptrdiff_t num_elements = longer_end - longer_begin;
+        if (!StdSortIfLessThanThreshold<Policy>(longer_begin, longer_end, num_elements, extract_key))
+        {
+            void (*sort_next_element)(It, It, std::ptrdiff_t, ExtractKey &, void *) = static_cast<void (*)(It, It, std::ptrdiff_t, ExtractKey &, void *)>(&sort_from_recursion);
+            InplaceSorter<Policy, ElementSubKey>::sort(longer_begin, longer_end, num_elements, extract_key, sort_next_element, sort_data);
+        }
+    }
+
+    template<typename It, typename ExtractKey>
+    static void sort_from_recursion(It begin, It end, std::ptrdiff_t, ExtractKey & extract_key, void * next_sort_data)
+    {
+        ListSortData<It, ExtractKey> offset = *static_cast<ListSortData<It, ExtractKey> *>(next_sort_data);
+        ++offset.current_index;
+        --offset.recursion_limit;
+        if (offset.recursion_limit == 0)
+        {
+            StdSortFallback(begin, end, extract_key);
+        }
+        else
+        {
+            sort(begin, end, extract_key, &offset);
+        }
+    }
+
+
+    template<typename It, typename ExtractKey>
+    static void sort(It begin, It end, std::ptrdiff_t, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * next_sort_data)
+    {
+        ListSortData<It, ExtractKey> offset;
+        offset.current_index = 0;
+        offset.recursion_limit = Policy::list_recursion_limit;
+        offset.next_sort = next_sort;
+        offset.next_sort_data = next_sort_data;
+        sort(begin, end, extract_key, &offset);
+    }
+};
+
+template<typename Policy, typename CurrentSubKey, typename ListType>
+struct InplaceSorter<Policy, CurrentSubKey, DescendingList<ListType>> : ListInplaceSorter<Policy, CurrentSubKey, ListType, true>
+{
+};
+
+template<typename Policy, typename CurrentSubKey>
+struct InplaceSorter<Policy, CurrentSubKey, bool>
+{
+    template<typename It, typename ExtractKey>
+    static void sort(It begin, It end, std::ptrdiff_t, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * sort_data)
+    {
+        It middle = std::partition(begin, end, [&](auto && a){ return !CurrentSubKey::sub_key(extract_key(a), sort_data); });
+        if (next_sort)
+        {
+            next_sort(begin, middle, middle - begin, extract_key, sort_data);
+            next_sort(middle, end, end - middle, extract_key, sort_data);
+        }
+    }
+};
+
+template<typename Policy, typename CurrentSubKey>
+struct InplaceSorter<Policy, CurrentSubKey, uint8_t> : UnsignedInplaceSorter<Policy, CurrentSubKey, 1>
+{
+};
+
+template<typename Policy, typename CurrentSubKey>
+struct InplaceSorter<Policy, CurrentSubKey, uint16_t> : UnsignedInplaceSorter<Policy, CurrentSubKey, 2>
+{
+};
+template<typename Policy, typename CurrentSubKey>
+struct InplaceSorter<Policy, CurrentSubKey, uint32_t> : UnsignedInplaceSorter<Policy, CurrentSubKey, 4>
+{
+};
+template<typename Policy, typename CurrentSubKey>
+struct InplaceSorter<Policy, CurrentSubKey, uint64_t> : UnsignedInplaceSorter<Policy, CurrentSubKey, 8>
+{
+};
+#ifdef SKA_SORT_INT128
+template<typename Policy, typename CurrentSubKey>
+struct InplaceSorter<Policy, CurrentSubKey, unsigned __int128> : UnsignedInplaceSorter<Policy, CurrentSubKey, 16>
+{
+};
+#endif
+template<typename Policy, typename CurrentSubKey, typename SubKeyType, typename Enable = void>
+struct FallbackInplaceSorter;
+
+template<typename Policy, typename CurrentSubKey, typename SubKeyType>
+struct InplaceSorter : FallbackInplaceSorter<Policy, CurrentSubKey, SubKeyType>
+{
+};
+
+template<typename Policy, typename CurrentSubKey, typename SubKeyType>
+struct FallbackInplaceSorter<Policy, CurrentSubKey, SubKeyType, typename std::enable_if<has_subscript_operator<SubKeyType>::value>::type>
+	: ListInplaceSorter<Policy, CurrentSubKey, SubKeyType>
+{
+};
+
+template<typename Policy, typename CurrentSubKey>
+struct SortStarter;
+template<typename Policy>
+struct SortStarter<Policy, SubKey<void>>
+{
+    template<typename It, typename ExtractKey>
+    static void sort(It, It, std::ptrdiff_t, ExtractKey &, void *)
+    {
+    }
+};
+
+template<typename Policy, typename CurrentSubKey>
+struct SortStarter
+{
+    template<typename It, typename ExtractKey>
+    static void sort(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, void * next_sort_data = nullptr)
+    {
+        if (StdSortIfLessThanThreshold<Policy>(begin, end, num_elements, extract_key))
+            return;
+
+        void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *) = static_cast<void (*)(It, It, std::ptrdiff_t, ExtractKey &, void *)>(&SortStarter<Policy, typename CurrentSubKey::next>::sort);
+        if (next_sort == static_cast<void (*)(It, It, std::ptrdiff_t, ExtractKey &, void *)>(&SortStarter<Policy, SubKey<void>>::sort))
+            next_sort = nullptr;
+        InplaceSorter<Policy, CurrentSubKey>::sort(begin, end, num_elements, extract_key, next_sort, next_sort_data);
+    }
+};
+
+template<typename Policy, typename It, typename ExtractKey>
+void inplace_radix_sort(It begin, It end, ExtractKey & extract_key)
+{
+    using SubKey = SubKey<decltype(extract_key(*begin))>;
+    SortStarter<Policy, SubKey>::sort(begin, end, end - begin, extract_key);
+}
+
+// input often comes from stages that leave it sorted, reversed, or sorted
+// except for a few elements appended at the end. before doing any radix
+// sort passes, we look for the longest sorted prefix. on random input that
+// stops after a few elements. a tail of up to 1/PresortedTailDivisor of the
+// elements gets sorted on its own and then merged with the sorted prefix
+static constexpr std::ptrdiff_t PresortedTailDivisor = 8;
+
+enum class Presortedness
+{
+    Unsorted,
+    Sorted,
+    // strictly descending, so reversing keeps equal elements in order
+    Reversed,
+    // sorted up to the returned iterator, with a short tail after that
+    SortedPrefix
+};
+
+template<typename It, typename ExtractKey>
+Presortedness find_presortedness(It begin, It end, ExtractKey & extract_key, It & sorted_end)
+{
+    std::ptrdiff_t num_elements = end - begin;
+    if (num_elements < 2)
+        return Presortedness::Sorted;
+    It it = begin;
+    It next = begin + 1;
+    if (radix_less(extract_key(*next), extract_key(*it)))
+    {
+        for (++it, ++next; next != end; ++it, ++next)
+        {
+            if (!radix_less(extract_key(*next), extract_key(*it)))
+                return Presortedness::Unsorted;
+        }
+        return Presortedness::Reversed;
+    }
+    for (++it, ++next; next != end; ++it, ++next)
+    {
+        if (radix_less(extract_key(*next), extract_key(*it)))
+            break;
+    }
+    if (next == end)
+        return Presortedness::Sorted;
+    sorted_end = next;
+    if ((end - next) * PresortedTailDivisor > num_elements)
+        return Presortedness::Unsorted;
+    return Presortedness::SortedPrefix;
+}
+
+// merges the sorted range [begin, middle) with the shorter sorted range
+// [middle, end). only the second range gets moved to a temporary buffer. the
+// merge goes backwards from the end, so equal elements stay in order
+template<typename It, typename ExtractKey>
+void merge_with_sorted_tail(It begin, It middle, It end, ExtractKey & extract_key)
+{
+    std::vector<typename std::iterator_traits<It>::value_type> tail(std::make_move_iterator(middle), std::make_move_iterator(end));
+    auto tail_end = tail.end();
+    It out = end;
+    while (tail_end != tail.begin())
+    {
+        if (middle != begin && radix_less(extract_key(*(tail_end - 1)), extract_key(*(middle - 1))))
+            *--out = std::move(*--middle);
+        else
+            *--out = std::move(*--tail_end);
+    }
+}
+
+// returns true if the input was presorted, in which case it is sorted now
+template<typename It, typename ExtractKey, typename SortTail>
+bool inplace_sort_if_presorted(It begin, It end, ExtractKey & extract_key, SortTail && sort_tail)
+{
+    It sorted_end;
+    switch (find_presortedness(begin, end, extract_key, sorted_end))
+    {
+    case Presortedness::Unsorted:
+        return false;
+    case Presortedness::Sorted:
+        return true;
+    case Presortedness::Reversed:
+        std::reverse(begin, end);
+        return true;
+    case Presortedness::SortedPrefix:
+        sort_tail(sorted_end, end);
+        merge_with_sorted_tail(begin, sorted_end, end, extract_key);
+        return true;
+    }
+    return false;
+}
+
+template<typename Key, typename It, typename OutIt, typename ExtractKey>
+bool radix_sort_checking_presorted(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings);
+
+struct IdentityFunctor
+{
+    template<typename T>
+    decltype(auto) operator()(T && i) const
+    {
+        return std::forward<T>(i);
+    }
+};
+
+// the argsorts sort an array of indices instead of the elements. numeric
+// keys and keys that get returned by value are computed once and stored in
+// an array, so that the sort only reads the elements once. keys that are
+// references into the elements are read from there
+template<typename KeyResult, typename Enable = void>
+struct ArgsortKeyStorage
+{
+    static constexpr bool cached = !std::is_reference<KeyResult>::value;
+    static constexpr bool numeric = false;
+};
+template<typename KeyResult>
+struct ArgsortKeyStorage<KeyResult, void_t<decltype(to_unsigned_or_bool(std::declval<KeyResult>()))>>
+{
+    static constexpr bool cached = true;
+    static constexpr bool numeric = true;
+};
+template<typename It, typename ExtractKey, typename KeyResult = decltype(std::declval<ExtractKey &>()(*std::declval<It>())), typename Enable = void>
+struct ArgsortKeys
+{
+    using key_type = typename std::decay<KeyResult>::type;
+    static constexpr bool numeric = false;
+    static constexpr bool packable = false;
+
+    ArgsortKeys(It begin, std::ptrdiff_t num_elements, ExtractKey & extract_key)
+    {
+        keys.reserve(num_elements);
+        for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+            keys.push_back(extract_key(begin[i]));
+    }
+
+    template<typename Index>
+    const key_type & operator()(Index index) const
+    {
+        return keys[index];
+    }
+
+    std::vector<key_type> keys;
+};
+template<typename It, typename ExtractKey, typename KeyResult>
+struct ArgsortKeys<It, ExtractKey, KeyResult, typename std::enable_if<ArgsortKeyStorage<KeyResult>::numeric>::type>
+{
+    using key_type = decltype(to_unsigned_or_bool(std::declval<KeyResult>()));
+    static constexpr bool numeric = true;
+    // keys of up to four bytes get packed together with a 32 bit index
+    static constexpr bool packable = sizeof(key_type) <= 4;
+
+    ArgsortKeys(It begin, std::ptrdiff_t num_elements, ExtractKey & extract_key)
+    {
+        keys.reserve(num_elements);
+        for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+            keys.push_back(to_unsigned_or_bool(extract_key(begin[i])));
+    }
+
+    template<typename Index>
+    key_type operator()(Index index) const
+    {
+        return keys[index];
+    }
+
+    std::vector<key_type> keys;
+};
+template<typename It, typename ExtractKey, typename KeyResult>
+struct ArgsortKeys<It, ExtractKey, KeyResult, typename std::enable_if<!ArgsortKeyStorage<KeyResult>::cached>::type>
+{
+    static constexpr bool numeric = false;
+    static constexpr bool packable = false;
+
+    ArgsortKeys(It begin, std::ptrdiff_t, ExtractKey & extract_key)
+        : begin(begin), extract_key(extract_key)
+    {
+    }
+
+    template<typename Index>
+    decltype(auto) operator()(Index index) const
+    {
+        return extract_key(begin[index]);
+    }
+
+    It begin;
+    ExtractKey & extract_key;
+};
+
+template<typename Index, typename Keys, typename Enable = void>
+struct Argsorter
+{
+    template<typename Policy, typename It, typename OutIt, typename ExtractKey>
+    static void sort(It begin, std::ptrdiff_t num_elements, OutIt index_out, ExtractKey & extract_key)
+    {
+        Keys keys(begin, num_elements, extract_key);
+        std::vector<Index> indices(num_elements);
+        for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+            indices[i] = static_cast<Index>(i);
+        inplace_radix_sort<Policy>(indices.begin(), indices.end(), keys);
+        std::copy(indices.begin(), indices.end(), index_out);
+    }
+
+    template<bool CheckPresorted = true, typename It, typename OutIt, typename ExtractKey>
+    static void stable_sort(It begin, std::ptrdiff_t num_elements, OutIt index_out, ExtractKey & extract_key)
+    {
+        Keys keys(begin, num_elements, extract_key);
+        std::vector<Index> indices(num_elements);
+        for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+            indices[i] = static_cast<Index>(i);
+        std::vector<Index> buffer(num_elements);
+        using key_type = decltype(keys(Index()));
+        bool in_buffer = CheckPresorted
+            ? radix_sort_checking_presorted<key_type>(indices.begin(), indices.end(), buffer.begin(), keys, RadixSortSettings())
+            : RadixSorter<key_type>::sort(indices.begin(), indices.end(), buffer.begin(), keys, RadixSortSettings());
+        if (in_buffer)
+            std::copy(buffer.begin(), buffer.end(), index_out);
+        else
+            std::copy(indices.begin(), indices.end(), index_out);
+    }
+};
+// other numeric keys get sorted next to their index, so that the sort
+// reads the keys in order instead of looking them up through the indices
+template<typename Index, typename Keys>
+struct Argsorter<Index, Keys, typename std::enable_if<Keys::numeric && !(Keys::packable && std::is_same<Index, std::uint32_t>::value)>::type>
+{
+    using key_index = std::pair<typename Keys::key_type, Index>;
+
+    template<typename It, typename ExtractKey>
+    static std::vector<key_index> pair_with_index(It begin, std::ptrdiff_t num_elements, ExtractKey & extract_key)
+    {
+        std::vector<key_index> pairs(num_elements);
+        for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+            pairs[i] = { to_unsigned_or_bool(extract_key(begin[i])), static_cast<Index>(i) };
+        return pairs;
+    }
+
+    template<typename Policy, typename It, typename OutIt, typename ExtractKey>
+    static void sort(It begin, std::ptrdiff_t num_elements, OutIt index_out, ExtractKey & extract_key)
+    {
+        std::vector<key_index> pairs = pair_with_index(begin, num_elements, extract_key);
+        auto key = [](const key_index & pair){ return pair.first; };
+        inplace_radix_sort<Policy>(pairs.begin(), pairs.end(), key);
+        std::transform(pairs.begin(), pairs.end(), index_out, [](const key_index & pair){ return pair.second; });
+    }
+
+    template<bool CheckPresorted = true, typename It, typename OutIt, typename ExtractKey>
+    static void stable_sort(It begin, std::ptrdiff_t num_elements, OutIt index_out, ExtractKey & extract_key)
+    {
+        std::vector<key_index> pairs = pair_with_index(begin, num_elements, extract_key);
+        std::vector<key_index> buffer(num_elements);
+        auto key = [](const key_index & pair){ return pair.first; };
+        bool in_buffer = CheckPresorted
+            ? radix_sort_checking_presorted<typename Keys::key_type>(pairs.begin(), pairs.end(), buffer.begin(), key, RadixSortSettings())
+            : RadixSorter<typename Keys::key_type>::sort(pairs.begin(), pairs.end(), buffer.begin(), key, RadixSortSettings());
+        const std::vector<key_index> & sorted = in_buffer ? buffer : pairs;
+        std::transform(sorted.begin(), sorted.end(), index_out, [](const key_index & pair){ return pair.second; });
+    }
+};
+// the key goes into the upper half and the index into the lower half of a
+// 64 bit integer. sorting those integers by themselves orders equal keys by
+// index, so this is stable either way
+template<typename Keys>
+struct Argsorter<std::uint32_t, Keys, typename std::enable_if<Keys::packable>::type>
+{
+    template<typename It, typename ExtractKey>
+    static std::vector<std::uint64_t> pack(It begin, std::ptrdiff_t num_elements, ExtractKey & extract_key)
+    {
+        std::vector<std::uint64_t> packed(num_elements);
+        for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+            packed[i] = (static_cast<std::uint64_t>(to_unsigned_or_bool(extract_key(begin[i]))) << 32) | static_cast<std::uint64_t>(i);
+        return packed;
+    }
+
+    template<typename Policy, typename It, typename OutIt, typename ExtractKey>
+    static void sort(It begin, std::ptrdiff_t num_elements, OutIt index_out, ExtractKey & extract_key)
+    {
+        std::vector<std::uint64_t> packed = pack(begin, num_elements, extract_key);
+        IdentityFunctor identity;
+        inplace_radix_sort<Policy>(packed.begin(), packed.end(), identity);
+        std::transform(packed.begin(), packed.end(), index_out, [](std::uint64_t value){ return static_cast<std::uint32_t>(value); });
+    }
+
+    template<bool CheckPresorted = true, typename It, typename OutIt, typename ExtractKey>
+    static void stable_sort(It begin, std::ptrdiff_t num_elements, OutIt index_out, ExtractKey & extract_key)
+    {
+        std::vector<std::uint64_t> packed = pack(begin, num_elements, extract_key);
+        std::vector<std::uint64_t> buffer(num_elements);
+        auto key = [](std::uint64_t value){ return static_cast<std::uint32_t>(value >> 32); };
+        bool in_buffer = CheckPresorted
+            ? radix_sort_checking_presorted<std::uint32_t>(packed.begin(), packed.end(), buffer.begin(), key, RadixSortSettings())
+            : RadixSorter<std::uint32_t>::sort(packed.begin(), packed.end(), buffer.begin(), key, RadixSortSettings());
+        const std::vector<std::uint64_t> & sorted = in_buffer ? buffer : packed;
+        std::transform(sorted.begin(), sorted.end(), index_out, [](std::uint64_t value){ return static_cast<std::uint32_t>(value); });
+    }
+};
+
+// the keys of a column sort get moved next to their row index and sorted.
+// after that the keys get moved back in order and every payload column gets
+// gathered through the row indices. Policy is void for the stable sort
+template<typename Policy>
+struct ColumnSorter
+{
+    template<typename It>
+    static void sort(It begin, It end)
+    {
+        auto key = [](auto && row) -> const auto & { return row.first; };
+        inplace_radix_sort<Policy>(begin, end, key);
+    }
+};
+template<>
+struct ColumnSorter<void>
+{
+    template<typename It>
+    static void sort(It begin, It end)
+    {
+        auto key = [](auto && row) -> const auto & { return row.first; };
+        std::vector<typename std::iterator_traits<It>::value_type> buffer(end - begin);
+        if (radix_sort_checking_presorted<decltype(key(*begin))>(begin, end, buffer.begin(), key, RadixSortSettings()))
+            std::move(buffer.begin(), buffer.end(), begin);
+    }
+};
+// moves column[rows[i].second] to column[i] through a buffer. unlike
+// following the cycles of the permutation, the loads don't depend on each
+// other, so many cache misses can be in flight at once
+template<typename Rows, typename It>
+int gather_column(const Rows & rows, It column)
+{
+    std::vector<typename std::iterator_traits<It>::value_type> gathered;
+    gathered.reserve(rows.size());
+    for (const auto & row : rows)
+        gathered.push_back(std::move(column[row.second]));
+    std::move(gathered.begin(), gathered.end(), column);
+    return 0;
+}
+template<typename Policy, typename Index, typename KeyIt, typename... PayloadIts>
+void sort_columns_with_index(KeyIt keys_begin, std::ptrdiff_t num_elements, PayloadIts... payload_begins)
+{
+    std::vector<std::pair<typename std::iterator_traits<KeyIt>::value_type, Index>> rows;
+    rows.reserve(num_elements);
+    for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+        rows.emplace_back(std::move(keys_begin[i]), static_cast<Index>(i));
+    ColumnSorter<Policy>::sort(rows.begin(), rows.end());
+    for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+        keys_begin[i] = std::move(rows[i].first);
+    int ignored[] = { 0, gather_column(rows, payload_begins)... };
+    static_cast<void>(ignored);
+}
+template<typename Policy, typename KeyIt, typename... PayloadIts>
+void sort_columns(KeyIt keys_begin, KeyIt keys_end, PayloadIts... payload_begins)
+{
+    std::ptrdiff_t num_elements = keys_end - keys_begin;
+    if (static_cast<std::uint64_t>(num_elements) <= std::numeric_limits<std::uint32_t>::max())
+        sort_columns_with_index<Policy, std::uint32_t>(keys_begin, num_elements, payload_begins...);
+    else
+        sort_columns_with_index<Policy, std::uint64_t>(keys_begin, num_elements, payload_begins...);
+}
+
+// a stable sort for every key that ska_sort can sort: the indices of the
+// elements get sorted by their key followed by the index itself, so that
+// equal keys stay in input order. then the elements get moved into the
+// buffer in that order
+template<typename Policy, typename Index, typename It, typename OutIt, typename ExtractKey>
+void stable_sort_copy_with_index(It begin, std::ptrdiff_t num_elements, OutIt buffer_begin, ExtractKey & extract_key)
+{
+    ArgsortKeys<It, ExtractKey> keys(begin, num_elements, extract_key);
+    std::vector<Index> indices(num_elements);
+    for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+        indices[i] = static_cast<Index>(i);
+    auto key_then_index = [&](Index index)
+    {
+        return std::tuple<decltype(keys(index)), Index>(keys(index), index);
+    };
+    inplace_radix_sort<Policy>(indices.begin(), indices.end(), key_then_index);
+    for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+        buffer_begin[i] = std::move(begin[indices[i]]);
+}
+
+// elements of at least Threshold bytes get sorted through an array of
+// keys and indices, so that every element gets moved once. see
+// KeyIndexSorter
+template<typename It, size_t Threshold>
+struct UseKeyIndexSort
+{
+    static constexpr bool value = sizeof(typename std::iterator_traits<It>::value_type) >= Threshold && std::is_reference<decltype(*std::declval<It>())>::value;
+};
+template<bool Enabled>
+struct KeyIndexSorter
+{
+    template<typename Policy, typename It, typename ExtractKey>
+    static bool sort(It, It, ExtractKey &)
+    {
+        return false;
+    }
+    template<typename It, typename OutIt, typename ExtractKey>
+    static bool sort_copy(It, It, OutIt, ExtractKey &)
+    {
+        return false;
+    }
+};
+// sorts the indices of the elements by their keys, then moves every element
+// to its place. sort follows the cycles of the permutation, sort_copy moves
+// the elements into the buffer in sorted order
+template<>
+struct KeyIndexSorter<true>
+{
+    template<typename Policy, typename It, typename ExtractKey>
+    static bool sort(It begin, It end, ExtractKey & extract_key)
+    {
+        std::ptrdiff_t num_elements = end - begin;
+        if (num_elements < Policy::std_sort_threshold)
+            return false;
+        if (static_cast<std::uint64_t>(num_elements) <= std::numeric_limits<std::uint32_t>::max())
+            sort_with_index<std::uint32_t>(begin, num_elements, extract_key);
+        else
+            sort_with_index<std::uint64_t>(begin, num_elements, extract_key);
+        return true;
+    }
+    template<typename It, typename OutIt, typename ExtractKey>
+    static bool sort_copy(It begin, It end, OutIt buffer_begin, ExtractKey & extract_key)
+    {
+        std::ptrdiff_t num_elements = end - begin;
+        if (static_cast<std::uint64_t>(num_elements) <= std::numeric_limits<std::uint32_t>::max())
+            sort_copy_with_index<std::uint32_t>(begin, num_elements, buffer_begin, extract_key);
+        else
+            sort_copy_with_index<std::uint64_t>(begin, num_elements, buffer_begin, extract_key);
+        return true;
+    }
+
+private:
+    // the thresholds of the caller's policy are for its elements, which are
+    // large. what gets sorted here are much smaller keys and indices
+    template<typename Index, typename It, typename ExtractKey>
+    static void sort_with_index(It begin, std::ptrdiff_t num_elements, ExtractKey & extract_key)
+    {
+        using key_index = std::pair<typename std::decay<decltype(extract_key(*begin))>::type, Index>;
+        std::vector<Index> sources(num_elements);
+        Argsorter<Index, ArgsortKeys<It, ExtractKey>>::template sort<ska_sort_default_policy<sizeof(key_index)>>(begin, num_elements, sources.begin(), extract_key);
+        apply_permutation(begin, sources.data(), num_elements);
+    }
+    template<typename Index, typename It, typename OutIt, typename ExtractKey>
+    static void sort_copy_with_index(It begin, std::ptrdiff_t num_elements, OutIt buffer_begin, ExtractKey & extract_key)
+    {
+        std::vector<Index> sources(num_elements);
+        // only gets called after radix_sort_checking_presorted found the
+        // input unsorted, so the keys don't need to be checked again
+        Argsorter<Index, ArgsortKeys<It, ExtractKey>>::template stable_sort<false>(begin, num_elements, sources.begin(), extract_key);
+        for (std::ptrdiff_t i = 0; i < num_elements; ++i)
+            buffer_begin[i] = std::move(begin[sources[i]]);
+    }
+};
+
+// the entry point of ska_sort. the sorts inside of this file call
+// inplace_radix_sort directly, so that ranges that got split off don't get
+// checked for presorted input or copied into keys and indices again
+template<typename Policy, typename It, typename ExtractKey>
+void inplace_radix_sort_checking_presorted(It begin, It end, ExtractKey & extract_key)
+{
+    auto sort = [&](It sort_begin, It sort_end)
+    {
+        if (!KeyIndexSorter<UseKeyIndexSort<It, SKA_SORT_KEY_INDEX_THRESHOLD>::value>::template sort<Policy>(sort_begin, sort_end, extract_key))
+            inplace_radix_sort<Policy>(sort_begin, sort_end, extract_key);
+    };
+    if (!inplace_sort_if_presorted(begin, end, extract_key, sort))
+        sort(begin, end);
+}
+
+// the same check for the sorts that use a buffer. returns whether the
+// result ended up in the buffer, like RadixSorter::sort. sorted input stays
+// where it is. reversed input gets moved to the buffer in one pass, so that
+// like after a radix sort pass, the elements are in both ranges. equal
+// elements stay in order
+template<typename Key, typename It, typename OutIt, typename ExtractKey>
+bool radix_sort_checking_presorted(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, const RadixSortSettings & settings)
+{
+    It sorted_end;
+    switch (find_presortedness(begin, end, extract_key, sorted_end))
+    {
+    case Presortedness::Unsorted:
+        if (settings.thread_count == 1 && KeyIndexSorter<UseKeyIndexSort<It, SKA_SORT_RADIX_SORT_KEY_INDEX_THRESHOLD>::value && std::is_reference<decltype(*buffer_begin)>::value>::sort_copy(begin, end, buffer_begin, extract_key))
+            return true;
+        return RadixSorter<Key>::sort(begin, end, buffer_begin, extract_key, settings);
+    case Presortedness::Sorted:
+        return false;
+    case Presortedness::Reversed:
+        std::move(std::make_reverse_iterator(end), std::make_reverse_iterator(begin), buffer_begin);
+        return true;
+    case Presortedness::SortedPrefix:
+        break;
+    }
+    std::ptrdiff_t tail_offset = sorted_end - begin;
+    std::ptrdiff_t tail_size = end - sorted_end;
+    if (RadixSorter<Key>::sort(sorted_end, end, buffer_begin + tail_offset, extract_key, settings))
+        std::move(buffer_begin + tail_offset, buffer_begin + (tail_offset + tail_size), sorted_end);
+    std::merge(std::make_move_iterator(begin), std::make_move_iterator(sorted_end), std::make_move_iterator(sorted_end), std::make_move_iterator(end), buffer_begin, [&](auto && l, auto && r){ return radix_less(extract_key(l), extract_key(r)); });
+    return true;
+}
+
+// the first element in [begin, end) whose key is not less than the key of
+// value, or greater than it if Upper, in radix order. like std::lower_bound
+// and std::upper_bound, but extract_key only gets called on elements
+template<bool Upper, typename It, typename T, typename ExtractKey>
+It partition_point_by_key(It begin, It end, const T & value, ExtractKey & extract_key)
+{
+    std::ptrdiff_t count = end - begin;
+    while (count > 0)
+    {
+        std::ptrdiff_t step = count / 2;
+        It it = begin + step;
+        bool go_right = Upper ? !radix_less(extract_key(value), extract_key(*it)) : radix_less(extract_key(*it), extract_key(value));
+        if (go_right)
+        {
+            begin = it + 1;
+            count -= step + 1;
+        }
+        else
+            count = step;
+    }
+    return begin;
+}
+// merges the sorted ranges [begin, middle) and [middle, end) without
+// reordering equal elements. if one of the ranges fits into the buffer, that
+// range gets moved there and merged back. otherwise the longer range gets
+// cut in half, the matching part of the other range gets rotated next to
+// it, and both halves get merged by themselves
+template<typename It, typename BufferIt, typename ExtractKey>
+void merge_with_bounded_buffer(It begin, It middle, It end, BufferIt buffer, std::ptrdiff_t buffer_size, ExtractKey & extract_key)
+{
+    std::ptrdiff_t first_size = middle - begin;
+    std::ptrdiff_t second_size = end - middle;
+    if (first_size == 0 || second_size == 0 || !radix_less(extract_key(*middle), extract_key(*(middle - 1))))
+        return;
+    if (first_size <= buffer_size)
+    {
+        BufferIt buffer_end = std::move(begin, middle, buffer);
+        It out = begin;
+        while (buffer != buffer_end && middle != end)
+        {
+            if (radix_less(extract_key(*middle), extract_key(*buffer)))
+                *out++ = std::move(*middle++);
+            else
+                *out++ = std::move(*buffer++);
+        }
+        std::move(buffer, buffer_end, out);
+    }
+    else if (second_size <= buffer_size)
+    {
+        BufferIt buffer_end = std::move(middle, end, buffer);
+        It out = end;
+        while (buffer_end != buffer && middle != begin)
+        {
+            if (radix_less(extract_key(*(buffer_end - 1)), extract_key(*(middle - 1))))
+                *--out = std::move(*--middle);
+            else
+                *--out = std::move(*--buffer_end);
+        }
+        std::move_backward(buffer, buffer_end, out);
+    }
+    else
+    {
+        It first_cut;
+        It second_cut;
+        if (first_size > second_size)
+        {
+            first_cut = begin + first_size / 2;
+            second_cut = partition_point_by_key<false>(middle, end, *first_cut, extract_key);
+        }
+        else
+        {
+            second_cut = middle + second_size / 2;
+            first_cut = partition_point_by_key<true>(begin, middle, *second_cut, extract_key);
+        }
+        It new_middle = std::rotate(first_cut, middle, second_cut);
+        merge_with_bounded_buffer(begin, first_cut, new_middle, buffer, buffer_size, extract_key);
+        merge_with_bounded_buffer(new_middle, second_cut, end, buffer, buffer_size, extract_key);
+    }
+}
+// a stable sort that only needs a buffer of buffer_size elements: blocks of
+// that size get sorted with the radix sort, and then merged bottom up
+template<typename Key, typename It, typename ExtractKey>
+void stable_sort_with_bounded_buffer(It begin, It end, ExtractKey & extract_key, std::ptrdiff_t buffer_size)
+{
+    std::ptrdiff_t num_elements = end - begin;
+    buffer_size = std::max(std::ptrdiff_t(1), std::min(buffer_size, num_elements));
+    std::vector<typename std::iterator_traits<It>::value_type> buffer(buffer_size);
+    for (It block = begin; block != end;)
+    {
+        It block_end = block + std::min(buffer_size, end - block);
+        if (radix_sort_checking_presorted<Key>(block, block_end, buffer.begin(), extract_key, RadixSortSettings()))
+            std::move(buffer.begin(), buffer.begin() + (block_end - block), block);
+        block = block_end;
+    }
+    for (std::ptrdiff_t width = buffer_size; width < num_elements; width *= 2)
+    {
+        for (std::ptrdiff_t offset = 0; num_elements - offset > width; offset += 2 * width)
+        {
+            It middle = begin + (offset + width);
+            It merge_end = begin + std::min(offset + 2 * width, num_elements);
+            merge_with_bounded_buffer(begin + offset, middle, merge_end, buffer.begin(), buffer_size, extract_key);
+        }
+    }
+}
+
+template<typename Policy, typename CurrentSubKey, size_t NumBytes, size_t Offset = 0>
+struct ParallelUnsignedSorter
+{
+    using ThisByteSorter = UnsignedInplaceSorter<Policy, CurrentSubKey, NumBytes, Offset>;
+    using NextByteSorter = UnsignedInplaceSorter<Policy, CurrentSubKey, NumBytes, Offset + 1>;
+
+    template<typename It, typename ExtractKey>
+    static void sort(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), size_t thread_count)
     {
-        PartitionInfo partitions[256];
-        for (It it = begin; it != end; ++it)
+        std::vector<std::array<size_t, 256>> counts(thread_count);
+        run_in_parallel(thread_count, [&](size_t thread_index)
         {
-            ++partitions[current_byte(extract_key(*it), sort_data)].count;
-        }
+            std::pair<It, It> chunk = parallel_chunk(begin, num_elements, thread_count, thread_index);
+            std::array<size_t, 256> & thread_counts = counts[thread_index];
+            for (It it = chunk.first; it != chunk.second; ++it)
+            {
+                ++thread_counts[ThisByteSorter::current_byte(extract_key(*it), nullptr)];
+            }
+        });
+        size_t partition_ends[256];
         uint8_t remaining_partitions[256];
-        size_t total = 0;
         int num_partitions = 0;
+        size_t total = 0;
         for (int i = 0; i < 256; ++i)
         {
-            size_t count = partitions[i].count;
-            if (count)
+            size_t partition_begin = total;
+            for (std::array<size_t, 256> & thread_counts : counts)
             {
-                partitions[i].offset = total;
+                size_t count = thread_counts[i];
+                thread_counts[i] = total;
                 total += count;
+            }
+            partition_ends[i] = total;
+            if (total != partition_begin)
+            {
                 remaining_partitions[num_partitions] = i;
                 ++num_partitions;
             }
-            partitions[i].next_offset = total;
         }
-        for (uint8_t * last_remaining = remaining_partitions + num_partitions, * end_partition = remaining_partitions + 1; last_remaining > end_partition;)
+        if (num_partitions == 1)
         {
-            last_remaining = custom_std_partition(remaining_partitions, last_remaining, [&](uint8_t partition)
-            {
-                size_t & begin_offset = partitions[partition].offset;
-                size_t & end_offset = partitions[partition].next_offset;
-                if (begin_offset == end_offset)
-                    return false;
-
-                unroll_loop_four_times(begin + begin_offset, end_offset - begin_offset, [partitions = partitions, begin, &extract_key, sort_data](It it)
-                {
-                    uint8_t this_partition = current_byte(extract_key(*it), sort_data);
-                    size_t offset = partitions[this_partition].offset++;
-                    std::iter_swap(it, begin + offset);
-                });
-                return begin_offset != end_offset;
-            });
+            // all elements have the same byte here. no need to move anything
+            ParallelUnsignedSorter<Policy, CurrentSubKey, NumBytes, Offset + 1>::sort(begin, end, num_elements, extract_key, next_sort, thread_count);
+            return;
         }
-        if (Offset + 1 != NumBytes || next_sort)
+
+        using value_type = typename std::iterator_traits<It>::value_type;
+        std::allocator<value_type> allocator;
+        value_type * buffer = allocator.allocate(num_elements);
+        run_in_parallel(thread_count, [&](size_t thread_index)
         {
-            for (uint8_t * it = remaining_partitions + num_partitions; it != remaining_partitions; --it)
+            std::pair<It, It> chunk = parallel_chunk(begin, num_elements, thread_count, thread_index);
+            std::array<size_t, 256> & offsets = counts[thread_index];
+            for (It it = chunk.first; it != chunk.second; ++it)
             {
-                uint8_t partition = it[-1];
-                size_t start_offset = (partition == 0 ? 0 : partitions[partition - 1].next_offset);
-                size_t end_offset = partitions[partition].next_offset;
-                It partition_begin = begin + start_offset;
-                It partition_end = begin + end_offset;
-                std::ptrdiff_t num_elements = end_offset - start_offset;
-                if (!StdSortIfLessThanThreshold<StdSortThreshold>(partition_begin, partition_end, num_elements, extract_key))
-                {
-                    UnsignedInplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, NumBytes, Offset + 1>::sort(partition_begin, partition_end, num_elements, extract_key, next_sort, sort_data);
-                }
+                size_t offset = offsets[ThisByteSorter::current_byte(extract_key(*it), nullptr)]++;
+                ::new (static_cast<void *>(buffer + offset)) value_type(std::move(*it));
             }
-        }
-    }
-};
-
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey, size_t NumBytes>
-struct UnsignedInplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, NumBytes, NumBytes>
-{
-    template<typename It, typename ExtractKey>
-    inline static void sort(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * next_sort_data)
-    {
-        next_sort(begin, end, num_elements, extract_key, next_sort_data);
-    }
-};
-
-template<typename It, typename ExtractKey, typename ElementKey>
-size_t CommonPrefix(It begin, It end, size_t start_index, ExtractKey && extract_key, ElementKey && element_key)
-{
-    const auto & largest_match_list = extract_key(*begin);
-    size_t largest_match = largest_match_list.size();
-    if (largest_match == start_index)
-        return start_index;
-    for (++begin; begin != end; ++begin)
-    {
-        const auto & current_list = extract_key(*begin);
-        size_t current_size = current_list.size();
-        if (current_size < largest_match)
-        {
-            largest_match = current_size;
-            if (largest_match == start_index)
-                return start_index;
-        }
-        if (element_key(largest_match_list[start_index]) != element_key(current_list[start_index]))
-            return start_index;
-        for (size_t i = start_index + 1; i < largest_match; ++i)
+        });
+        run_in_parallel(thread_count, [&](size_t thread_index)
         {
-            if (element_key(largest_match_list[i]) != element_key(current_list[i]))
+            std::pair<value_type *, value_type *> chunk = parallel_chunk(buffer, num_elements, thread_count, thread_index);
+            It out = begin + (chunk.first - buffer);
+            for (value_type * it = chunk.first; it != chunk.second; ++it, ++out)
             {
-                largest_match = i;
-                break;
+                *out = std::move(*it);
+                it->~value_type();
             }
-        }
-    }
-    return largest_match;
-}
+        });
+        allocator.deallocate(buffer, num_elements);
 
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey, typename ListType>
-struct ListInplaceSorter
-{
-    using ElementSubKey = ListElementSubKey<CurrentSubKey, ListType>;
-    template<typename It, typename ExtractKey>
-    static void sort(It begin, It end, ExtractKey & extract_key, ListSortData<It, ExtractKey> * sort_data)
-    {
-        size_t current_index = sort_data->current_index;
-        void * next_sort_data = sort_data->next_sort_data;
-        auto current_key = [&](auto && elem) -> decltype(auto)
+        if (Offset + 1 == NumBytes && !next_sort)
+            return;
+        auto sort_partition = [&](uint8_t partition)
         {
-            return CurrentSubKey::sub_key(extract_key(elem), next_sort_data);
+            size_t start_offset = partition == 0 ? 0 : partition_ends[partition - 1];
+            size_t end_offset = partition_ends[partition];
+            std::ptrdiff_t partition_size = end_offset - start_offset;
+            if (!StdSortIfLessThanThreshold<Policy>(begin + start_offset, begin + end_offset, partition_size, extract_key))
+                NextByteSorter::sort(begin + start_offset, begin + end_offset, partition_size, extract_key, next_sort, nullptr);
         };
-        auto element_key = [&](auto && elem) -> decltype(auto)
+        // partitions that are too big to give to a single thread get split
+        // again using all threads. the rest are handed out biggest first to
+        // whichever thread is free
+        std::ptrdiff_t large_partition_size = num_elements / thread_count;
+        int num_small_partitions = 0;
+        for (int i = 0; i < num_partitions; ++i)
         {
-            return ElementSubKey::base::sub_key(elem, sort_data);
-        };
-        sort_data->current_index = current_index = CommonPrefix(begin, end, current_index, current_key, element_key);
-        It end_of_shorter_ones = std::partition(begin, end, [&](auto && elem)
+            uint8_t partition = remaining_partitions[i];
+            size_t start_offset = partition == 0 ? 0 : partition_ends[partition - 1];
+            std::ptrdiff_t partition_size = partition_ends[partition] - start_offset;
+            if (Offset + 1 != NumBytes && partition_size > large_partition_size)
+                ParallelUnsignedSorter<Policy, CurrentSubKey, NumBytes, Offset + 1>::sort(begin + start_offset, begin + partition_ends[partition], partition_size, extract_key, next_sort, thread_count);
+            else
+                remaining_partitions[num_small_partitions++] = partition;
+        }
+        std::sort(remaining_partitions, remaining_partitions + num_small_partitions, [&](uint8_t l, uint8_t r)
         {
-            return current_key(elem).size() <= current_index;
+            size_t l_begin = l == 0 ? 0 : partition_ends[l - 1];
+            size_t r_begin = r == 0 ? 0 : partition_ends[r - 1];
+            return partition_ends[l] - l_begin > partition_ends[r] - r_begin;
         });
-        std::ptrdiff_t num_shorter_ones = end_of_shorter_ones - begin;
-        if (sort_data->next_sort && !StdSortIfLessThanThreshold<StdSortThreshold>(begin, end_of_shorter_ones, num_shorter_ones, extract_key))
+        std::atomic<int> next_partition(0);
+        run_in_parallel(thread_count, [&](size_t)
         {
-            sort_data->next_sort(begin, end_of_shorter_ones, num_shorter_ones, extract_key, next_sort_data);
-        }
-        std::ptrdiff_t num_elements = end - end_of_shorter_ones;
-        if (!StdSortIfLessThanThreshold<StdSortThreshold>(end_of_shorter_ones, end, num_elements, extract_key))
-        {
-            void (*sort_next_element)(It, It, std::ptrdiff_t, ExtractKey &, void *) = static_cast<void (*)(It, It, std::ptrdiff_t, ExtractKey &, void *)>(&sort_from_recursion);
-            InplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, ElementSubKey>::sort(end_of_shorter_ones, end, num_elements, extract_key, sort_next_element, sort_data);
-        }
+            for (int i = next_partition++; i < num_small_partitions; i = next_partition++)
+            {
+                sort_partition(remaining_partitions[i]);
+            }
+        });
     }
+};
 
+template<typename Policy, typename CurrentSubKey, size_t NumBytes>
+struct ParallelUnsignedSorter<Policy, CurrentSubKey, NumBytes, NumBytes>
+{
     template<typename It, typename ExtractKey>
-    static void sort_from_recursion(It begin, It end, std::ptrdiff_t, ExtractKey & extract_key, void * next_sort_data)
+    static void sort(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), size_t)
     {
-        ListSortData<It, ExtractKey> offset = *static_cast<ListSortData<It, ExtractKey> *>(next_sort_data);
-        ++offset.current_index;
-        --offset.recursion_limit;
-        if (offset.recursion_limit == 0)
-        {
-            StdSortFallback(begin, end, extract_key);
-        }
-        else
-        {
-            sort(begin, end, extract_key, &offset);
-        }
+        if (next_sort)
+            next_sort(begin, end, num_elements, extract_key, nullptr);
     }
+};
 
-
+template<typename Policy, typename CurrentSubKey, typename SubKeyType = typename CurrentSubKey::sub_key_type>
+struct ParallelSorter
+{
     template<typename It, typename ExtractKey>
-    static void sort(It begin, It end, std::ptrdiff_t, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * next_sort_data)
+    static void sort(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, size_t)
     {
-        ListSortData<It, ExtractKey> offset;
-        offset.current_index = 0;
-        offset.recursion_limit = 16;
-        offset.next_sort = next_sort;
-        offset.next_sort_data = next_sort_data;
-        sort(begin, end, extract_key, &offset);
+        SortStarter<Policy, CurrentSubKey>::sort(begin, end, num_elements, extract_key);
     }
 };
-
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey>
-struct InplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, bool>
+template<typename Policy, typename CurrentSubKey, size_t NumBytes>
+struct ParallelUnsignedSorterStarter
 {
     template<typename It, typename ExtractKey>
-    static void sort(It begin, It end, std::ptrdiff_t, ExtractKey & extract_key, void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *), void * sort_data)
+    static void sort(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, size_t thread_count)
     {
-        It middle = std::partition(begin, end, [&](auto && a){ return !CurrentSubKey::sub_key(extract_key(a), sort_data); });
-        if (next_sort)
-        {
-            next_sort(begin, middle, middle - begin, extract_key, sort_data);
-            next_sort(middle, end, end - middle, extract_key, sort_data);
-        }
+        void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *) = static_cast<void (*)(It, It, std::ptrdiff_t, ExtractKey &, void *)>(&SortStarter<Policy, typename CurrentSubKey::next>::sort);
+        if (next_sort == static_cast<void (*)(It, It, std::ptrdiff_t, ExtractKey &, void *)>(&SortStarter<Policy, SubKey<void>>::sort))
+            next_sort = nullptr;
+        ParallelUnsignedSorter<Policy, CurrentSubKey, NumBytes>::sort(begin, end, num_elements, extract_key, next_sort, thread_count);
     }
 };
-
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey>
-struct InplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, uint8_t> : UnsignedInplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, 1>
+template<typename Policy, typename CurrentSubKey>
+struct ParallelSorter<Policy, CurrentSubKey, uint8_t> : ParallelUnsignedSorterStarter<Policy, CurrentSubKey, 1>
 {
 };
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey>
-struct InplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, uint16_t> : UnsignedInplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, 2>
+template<typename Policy, typename CurrentSubKey>
+struct ParallelSorter<Policy, CurrentSubKey, uint16_t> : ParallelUnsignedSorterStarter<Policy, CurrentSubKey, 2>
 {
 };
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey>
-struct InplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, uint32_t> : UnsignedInplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, 4>
+template<typename Policy, typename CurrentSubKey>
+struct ParallelSorter<Policy, CurrentSubKey, uint32_t> : ParallelUnsignedSorterStarter<Policy, CurrentSubKey, 4>
 {
 };
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey>
-struct InplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, uint64_t> : UnsignedInplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, 8>
+template<typename Policy, typename CurrentSubKey>
+struct ParallelSorter<Policy, CurrentSubKey, uint64_t> : ParallelUnsignedSorterStarter<Policy, CurrentSubKey, 8>
 {
 };
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey, typename SubKeyType, typename Enable = void>
-struct FallbackInplaceSorter;
-
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey, typename SubKeyType>
-struct InplaceSorter : FallbackInplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, SubKeyType>
+#ifdef SKA_SORT_INT128
+template<typename Policy, typename CurrentSubKey>
+struct ParallelSorter<Policy, CurrentSubKey, unsigned __int128> : ParallelUnsignedSorterStarter<Policy, CurrentSubKey, 16>
 {
 };
+#endif
 
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey, typename SubKeyType>
-struct FallbackInplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, SubKeyType, typename std::enable_if<has_subscript_operator<SubKeyType>::value>::type>
-	: ListInplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey, SubKeyType>
+template<typename Policy, typename It, typename ExtractKey>
+void parallel_inplace_radix_sort(It begin, It end, ExtractKey & extract_key, size_t thread_count)
 {
-};
+    std::ptrdiff_t num_elements = end - begin;
+    thread_count = clamp_thread_count(thread_count, num_elements);
+    // elements are moved through a temporary buffer, and proxy references
+    // like the one from std::vector<bool> can't be written from several
+    // threads at once
+    if (thread_count == 1 || !std::is_reference<decltype(*begin)>::value)
+    {
+        inplace_radix_sort_checking_presorted<Policy>(begin, end, extract_key);
+        return;
+    }
+    using SubKey = SubKey<decltype(extract_key(*begin))>;
+    auto sort = [&](It sort_begin, It sort_end)
+    {
+        std::ptrdiff_t num_to_sort = sort_end - sort_begin;
+        size_t threads = clamp_thread_count(thread_count, num_to_sort);
+        if (threads == 1)
+            inplace_radix_sort<Policy>(sort_begin, sort_end, extract_key);
+        else
+            ParallelSorter<Policy, SubKey>::sort(sort_begin, sort_end, num_to_sort, extract_key, threads);
+    };
+    if (!inplace_sort_if_presorted(begin, end, extract_key, sort))
+        sort(begin, end);
+}
+}
 
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey>
-struct SortStarter;
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold>
-struct SortStarter<StdSortThreshold, AmericanFlagSortThreshold, SubKey<void>>
+// sorts small ranges by first copying the keys into an array next to the
+// index of their element, then sorting that array and finally moving every
+// element to its place once. this only calls extract_key once per element
+// and moves every element once. that only pays off if moving elements is
+// expensive or if extract_key has to build the key. otherwise this uses
+// std::sort on the elements directly
+struct cached_key_small_sort
 {
     template<typename It, typename ExtractKey>
-    static void sort(It, It, std::ptrdiff_t, ExtractKey &, void *)
+    static void sort(It begin, It end, ExtractKey & extract_key)
     {
+        using key_result = decltype(extract_key(*begin));
+        using key_type = typename std::decay<key_result>::type;
+        constexpr bool expensive_moves = !std::is_trivially_copyable<typename std::iterator_traits<It>::value_type>::value;
+        constexpr bool built_keys = !std::is_reference<key_result>::value && !std::is_arithmetic<key_type>::value;
+        if (expensive_moves || built_keys)
+            detail::CachedKeySmallSort<key_type>::sort(begin, end, extract_key);
+        else
+            detail::StdSortFallback(begin, end, extract_key);
     }
 };
-
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename CurrentSubKey>
-struct SortStarter
+// sorts small ranges with std::sort
+struct std_sort_small_sort
 {
     template<typename It, typename ExtractKey>
-    static void sort(It begin, It end, std::ptrdiff_t num_elements, ExtractKey & extract_key, void * next_sort_data = nullptr)
+    static void sort(It begin, It end, ExtractKey & extract_key)
     {
-        if (StdSortIfLessThanThreshold<StdSortThreshold>(begin, end, num_elements, extract_key))
-            return;
-
-        void (*next_sort)(It, It, std::ptrdiff_t, ExtractKey &, void *) = static_cast<void (*)(It, It, std::ptrdiff_t, ExtractKey &, void *)>(&SortStarter<StdSortThreshold, AmericanFlagSortThreshold, typename CurrentSubKey::next>::sort);
-        if (next_sort == static_cast<void (*)(It, It, std::ptrdiff_t, ExtractKey &, void *)>(&SortStarter<StdSortThreshold, AmericanFlagSortThreshold, SubKey<void>>::sort))
-            next_sort = nullptr;
-        InplaceSorter<StdSortThreshold, AmericanFlagSortThreshold, CurrentSubKey>::sort(begin, end, num_elements, extract_key, next_sort, next_sort_data);
+        detail::StdSortFallback(begin, end, extract_key);
     }
 };
-
-template<std::ptrdiff_t StdSortThreshold, std::ptrdiff_t AmericanFlagSortThreshold, typename It, typename ExtractKey>
-void inplace_radix_sort(It begin, It end, ExtractKey & extract_key)
-{
-    using SubKey = SubKey<decltype(extract_key(*begin))>;
-    SortStarter<StdSortThreshold, AmericanFlagSortThreshold, SubKey>::sort(begin, end, end - begin, extract_key);
-}
-
-struct IdentityFunctor
+// sorts small ranges with insertion sort. only a good idea together with a
+// small std_sort_threshold
+struct insertion_sort_small_sort
 {
-    template<typename T>
-    decltype(auto) operator()(T && i) const
+    template<typename It, typename ExtractKey>
+    static void sort(It begin, It end, ExtractKey & extract_key)
     {
-        return std::forward<T>(i);
+        for (It it = begin + 1; it < end; ++it)
+        {
+            if (!(extract_key(*it) < extract_key(it[-1])))
+                continue;
+            typename std::iterator_traits<It>::value_type value = std::move(*it);
+            It hole = it;
+            do
+            {
+                *hole = std::move(hole[-1]);
+                --hole;
+            }
+            while (hole != begin && extract_key(value) < extract_key(hole[-1]));
+            *hole = std::move(value);
+        }
     }
 };
-}
 
 template<typename It, typename ExtractKey>
 static void ska_sort(It begin, It end, ExtractKey && extract_key)
 {
-    detail::inplace_radix_sort<128, 1024>(begin, end, extract_key);
+    detail::inplace_radix_sort_checking_presorted<ska_sort_default_policy<sizeof(typename std::iterator_traits<It>::value_type)>>(begin, end, extract_key);
+}
+
+// sorts like ska_sort, with the thresholds from the given policy. the
+// policy can be any type with the same members as ska_sort_policy
+template<typename It, typename ExtractKey, typename Policy>
+static void ska_sort(It begin, It end, ExtractKey && extract_key, Policy)
+{
+    detail::inplace_radix_sort_checking_presorted<Policy>(begin, end, extract_key);
 }
 
 template<typename It>
@@ -1426,17 +3583,33 @@ static void ska_sort(It begin, It end)
     ska_sort(begin, end, detail::IdentityFunctor());
 }
 
+// sorts like ska_sort, but splits the work across thread_count threads. if
+// thread_count is 0 it uses one thread per hardware thread. extract_key gets
+// called from several threads at once. needs temporary memory for one copy
+// of the input
+template<typename It, typename ExtractKey>
+static void parallel_ska_sort(It begin, It end, ExtractKey && extract_key, size_t thread_count = 0)
+{
+    detail::parallel_inplace_radix_sort<ska_sort_default_policy<sizeof(typename std::iterator_traits<It>::value_type)>>(begin, end, extract_key, thread_count);
+}
+
+template<typename It>
+static void parallel_ska_sort(It begin, It end)
+{
+    parallel_ska_sort(begin, end, detail::IdentityFunctor());
+}
+
 template<typename It, typename OutIt, typename ExtractKey>
 bool ska_sort_copy(It begin, It end, OutIt buffer_begin, ExtractKey && key)
 {
     std::ptrdiff_t num_elements = end - begin;
-    if (num_elements < 128 || detail::radix_sort_pass_count<typename std::result_of<ExtractKey(decltype(*begin))>::type> >= 8)
+    if (num_elements < 128 || detail::radix_sort_byte_pass_count<typename std::result_of<ExtractKey(decltype(*begin))>::type>() >= 8)
     {
         ska_sort(begin, end, key);
         return false;
     }
     else
-        return detail::RadixSorter<typename std::result_of<ExtractKey(decltype(*begin))>::type>::sort(begin, end, buffer_begin, key);
+        return detail::radix_sort_checking_presorted<typename std::result_of<ExtractKey(decltype(*begin))>::type>(begin, end, buffer_begin, key, detail::RadixSortSettings());
 }
 template<typename It, typename OutIt>
 bool ska_sort_copy(It begin, It end, OutIt buffer_begin)
@@ -1444,6 +3617,28 @@ bool ska_sort_copy(It begin, It end, OutIt buffer_begin)
     return ska_sort_copy(begin, end, buffer_begin, detail::IdentityFunctor());
 }
 
+template<typename It, typename OutIt, typename ExtractKey>
+bool parallel_ska_sort_copy(It begin, It end, OutIt buffer_begin, ExtractKey && key, size_t thread_count = 0)
+{
+    std::ptrdiff_t num_elements = end - begin;
+    detail::RadixSortSettings settings;
+    settings.thread_count = detail::clamp_thread_count(thread_count, num_elements);
+    if (!std::is_reference<decltype(*begin)>::value || !std::is_reference<decltype(*buffer_begin)>::value)
+        settings.thread_count = 1;
+    if (num_elements < 128 || detail::radix_sort_byte_pass_count<typename std::result_of<ExtractKey(decltype(*begin))>::type>() >= 8)
+    {
+        parallel_ska_sort(begin, end, key, settings.thread_count);
+        return false;
+    }
+    else
+        return detail::radix_sort_checking_presorted<typename std::result_of<ExtractKey(decltype(*begin))>::type>(begin, end, buffer_begin, key, settings);
+}
+template<typename It, typename OutIt>
+bool parallel_ska_sort_copy(It begin, It end, OutIt buffer_begin)
+{
+    return parallel_ska_sort_copy(begin, end, buffer_begin, detail::IdentityFunctor());
+}
+
 
 template<typename It, typename OutIt, typename ExtractKey>
 void counting_sort(It begin, It end, OutIt out_begin, ExtractKey && extract_key)
@@ -1460,18 +3655,152 @@ void counting_sort(It begin, It end, OutIt out_begin)
 template<typename It, typename OutIt, typename ExtractKey>
 bool radix_sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
 {
-    return detail::RadixSorter<typename std::result_of<ExtractKey(decltype(*begin))>::type>::sort(begin, end, buffer_begin, extract_key);
+    return detail::radix_sort_checking_presorted<typename std::result_of<ExtractKey(decltype(*begin))>::type>(begin, end, buffer_begin, extract_key, detail::RadixSortSettings());
 }
 template<typename It, typename OutIt>
 bool radix_sort(It begin, It end, OutIt buffer_begin)
 {
-    return detail::RadixSorter<decltype(*begin)>::sort(begin, end, buffer_begin, detail::IdentityFunctor());
+    return detail::radix_sort_checking_presorted<decltype(*begin)>(begin, end, buffer_begin, detail::IdentityFunctor(), detail::RadixSortSettings());
+}
+
+// like radix_sort, but every pass is split across thread_count threads. if
+// thread_count is 0 it uses one thread per hardware thread. extract_key gets
+// called from several threads at once
+template<typename It, typename OutIt, typename ExtractKey>
+bool parallel_radix_sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key, size_t thread_count = 0)
+{
+    detail::RadixSortSettings settings;
+    settings.thread_count = detail::clamp_thread_count(thread_count, end - begin);
+    // proxy references like the one from std::vector<bool> can't be written
+    // from several threads at once
+    if (!std::is_reference<decltype(*begin)>::value || !std::is_reference<decltype(*buffer_begin)>::value)
+        settings.thread_count = 1;
+    return detail::radix_sort_checking_presorted<typename std::result_of<ExtractKey(decltype(*begin))>::type>(begin, end, buffer_begin, extract_key, settings);
+}
+template<typename It, typename OutIt>
+bool parallel_radix_sort(It begin, It end, OutIt buffer_begin)
+{
+    return parallel_radix_sort(begin, end, buffer_begin, detail::IdentityFunctor());
+}
+
+// like radix_sort, but the scatter passes collect the elements for every
+// bucket in a small buffer and write them out a cache line at a time. this
+// is faster once the input is much bigger than the cache, and slower for
+// inputs that fit. falls back to the normal scatter for elements that are
+// not trivially copyable or are bigger than 16 bytes
+template<typename It, typename OutIt, typename ExtractKey>
+bool write_combining_radix_sort(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
+{
+    detail::RadixSortSettings settings;
+    settings.write_combining = true;
+    return detail::radix_sort_checking_presorted<typename std::result_of<ExtractKey(decltype(*begin))>::type>(begin, end, buffer_begin, extract_key, settings);
+}
+template<typename It, typename OutIt>
+bool write_combining_radix_sort(It begin, It end, OutIt buffer_begin)
+{
+    return write_combining_radix_sort(begin, end, buffer_begin, detail::IdentityFunctor());
+}
+
+// writes the indices of the elements in [begin, end) to index_out, in the
+// order that sorts the elements by extract_key. the elements don't get
+// moved. uses 32 bit indices while they are enough. equal keys end up in
+// no particular order
+template<typename It, typename OutIt, typename ExtractKey>
+void ska_argsort(It begin, It end, OutIt index_out, ExtractKey && extract_key)
+{
+    using Keys = detail::ArgsortKeys<It, typename std::remove_reference<ExtractKey>::type>;
+    std::ptrdiff_t num_elements = end - begin;
+    if (static_cast<std::uint64_t>(num_elements) <= std::numeric_limits<std::uint32_t>::max())
+        detail::Argsorter<std::uint32_t, Keys>::template sort<ska_sort_default_policy<sizeof(std::uint32_t)>>(begin, num_elements, index_out, extract_key);
+    else
+        detail::Argsorter<std::uint64_t, Keys>::template sort<ska_sort_default_policy<sizeof(std::uint64_t)>>(begin, num_elements, index_out, extract_key);
+}
+template<typename It, typename OutIt>
+void ska_argsort(It begin, It end, OutIt index_out)
+{
+    ska_argsort(begin, end, index_out, detail::IdentityFunctor());
+}
+
+// like ska_argsort, but uses radix_sort, so equal keys keep their order
+template<typename It, typename OutIt, typename ExtractKey>
+void radix_argsort(It begin, It end, OutIt index_out, ExtractKey && extract_key)
+{
+    using Keys = detail::ArgsortKeys<It, typename std::remove_reference<ExtractKey>::type>;
+    std::ptrdiff_t num_elements = end - begin;
+    if (static_cast<std::uint64_t>(num_elements) <= std::numeric_limits<std::uint32_t>::max())
+        detail::Argsorter<std::uint32_t, Keys>::stable_sort(begin, num_elements, index_out, extract_key);
+    else
+        detail::Argsorter<std::uint64_t, Keys>::stable_sort(begin, num_elements, index_out, extract_key);
+}
+template<typename It, typename OutIt>
+void radix_argsort(It begin, It end, OutIt index_out)
+{
+    radix_argsort(begin, end, index_out, detail::IdentityFunctor());
+}
+
+// sorts the key column [keys_begin, keys_end) and moves the elements of
+// every payload column the same way, so that rows stay together. the
+// columns have to be at least as long as the key column. needs temporary
+// memory for the keys with their row indices and for one payload column.
+// equal keys end up in no particular order
+template<typename KeyIt, typename... PayloadIts>
+void ska_sort_columns(KeyIt keys_begin, KeyIt keys_end, PayloadIts... payload_begins)
+{
+    using row = std::pair<typename std::iterator_traits<KeyIt>::value_type, std::uint32_t>;
+    detail::sort_columns<ska_sort_default_policy<sizeof(row)>>(keys_begin, keys_end, payload_begins...);
+}
+// like ska_sort_columns, but rows with equal keys keep their order
+template<typename KeyIt, typename... PayloadIts>
+void radix_sort_columns(KeyIt keys_begin, KeyIt keys_end, PayloadIts... payload_begins)
+{
+    detail::sort_columns<void>(keys_begin, keys_end, payload_begins...);
+}
+
+// a stable sort into the buffer, for every key that ska_sort can sort,
+// including strings and other lists. elements with equal keys keep their
+// input order. always returns true: the sorted elements end up in the
+// buffer, like the return value of ska_sort_copy says. needs temporary
+// memory for one index per element. for keys of fixed size radix_sort is
+// faster
+template<typename It, typename OutIt, typename ExtractKey>
+bool stable_ska_sort_copy(It begin, It end, OutIt buffer_begin, ExtractKey && extract_key)
+{
+    std::ptrdiff_t num_elements = end - begin;
+    if (static_cast<std::uint64_t>(num_elements) <= std::numeric_limits<std::uint32_t>::max())
+        detail::stable_sort_copy_with_index<ska_sort_default_policy<sizeof(std::uint32_t)>, std::uint32_t>(begin, num_elements, buffer_begin, extract_key);
+    else
+        detail::stable_sort_copy_with_index<ska_sort_default_policy<sizeof(std::uint64_t)>, std::uint64_t>(begin, num_elements, buffer_begin, extract_key);
+    return true;
+}
+template<typename It, typename OutIt>
+bool stable_ska_sort_copy(It begin, It end, OutIt buffer_begin)
+{
+    return stable_ska_sort_copy(begin, end, buffer_begin, detail::IdentityFunctor());
+}
+
+// a stable sort that needs less memory than radix_sort. blocks of
+// buffer_size elements get sorted with radix_sort and then merged. the
+// merges use the same buffer, and rotate elements once the ranges don't fit
+// into it anymore. the default buffer is a sixteenth of the input. a
+// smaller buffer means more merge passes
+template<typename It, typename ExtractKey>
+void stable_ska_sort(It begin, It end, ExtractKey && extract_key, std::ptrdiff_t buffer_size = 0)
+{
+    std::ptrdiff_t num_elements = end - begin;
+    if (buffer_size <= 0)
+        buffer_size = std::max(num_elements / 16, std::min(num_elements, std::ptrdiff_t(4096)));
+    detail::stable_sort_with_bounded_buffer<typename std::result_of<ExtractKey(decltype(*begin))>::type>(begin, end, extract_key, buffer_size);
+}
+template<typename It>
+void stable_ska_sort(It begin, It end)
+{
+    stable_ska_sort(begin, end, detail::IdentityFunctor());
 }
 
 template<typename It, typename ExtractKey>
 static void inplace_radix_sort(It begin, It end, ExtractKey && extract_key)
 {
-    detail::inplace_radix_sort<1, 1>(begin, end, extract_key);
+    detail::inplace_radix_sort<ska_sort_policy<1, 1>>(begin, end, extract_key);
 }
 
 template<typename It>
@@ -1483,7 +3812,7 @@ static void inplace_radix_sort(It begin, It end)
 template<typename It, typename ExtractKey>
 static void american_flag_sort(It begin, It end, ExtractKey && extract_key)
 {
-    detail::inplace_radix_sort<1, std::numeric_limits<std::ptrdiff_t>::max()>(begin, end, extract_key);
+    detail::inplace_radix_sort<ska_sort_policy<1, std::numeric_limits<std::ptrdiff_t>::max()>>(begin, end, extract_key);
 }
 
 template<typename It>
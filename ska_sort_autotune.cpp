@@ -0,0 +1,269 @@
+/*
+ * ska_sort_autotune.cpp
+ *
+ * measures the thresholds of ska_sort and radix_sort on the current
+ * machine and writes them to a header. usage:
+ *
+ *     ska_sort_autotune [output_header] [num_elements] [max_lsd_elements]
+ *
+ * and then compile with -DSKA_SORT_TUNING_HEADER='"output_header"'
+ */
+
+#include "ska_sort.hpp"
+#include "ska_sort_benchmark_data.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// a policy with thresholds that can be changed at runtime, so that the
+// sweep only needs one instantiation of ska_sort per data type
+struct TuningPolicy
+{
+    static std::ptrdiff_t std_sort_threshold;
+    static std::ptrdiff_t american_flag_sort_threshold;
+    static constexpr size_t list_recursion_limit = 16;
+    using small_sort = cached_key_small_sort;
+};
+std::ptrdiff_t TuningPolicy::std_sort_threshold = 128;
+std::ptrdiff_t TuningPolicy::american_flag_sort_threshold = 1024;
+
+static const std::ptrdiff_t std_sort_thresholds[] = { 16, 32, 64, 128, 256 };
+static const std::ptrdiff_t american_flag_sort_thresholds[] = { 256, 512, 1024, 2048, 4096, 8192 };
+static constexpr int num_std_sort_thresholds = sizeof(std_sort_thresholds) / sizeof(std_sort_thresholds[0]);
+static constexpr int num_american_flag_sort_thresholds = sizeof(american_flag_sort_thresholds) / sizeof(american_flag_sort_thresholds[0]);
+static constexpr int num_repetitions = 3;
+
+// the fastest of num_repetitions runs of sort on a fresh copy of input, in
+// milliseconds
+template<typename Container, typename Sort>
+double measure(const Container & input, Sort && sort)
+{
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < num_repetitions; ++i)
+    {
+        Container to_sort = input;
+        auto start = std::chrono::steady_clock::now();
+        sort(to_sort);
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+enum class SizeClass
+{
+    Small,
+    Medium,
+    Large
+};
+// has to match ska_sort_default_policy
+static SizeClass size_class(size_t element_size)
+{
+    if (element_size <= 8)
+        return SizeClass::Small;
+    else if (element_size <= 32)
+        return SizeClass::Medium;
+    else
+        return SizeClass::Large;
+}
+
+struct ThresholdSweep
+{
+    std::string name;
+    size_t element_size;
+    double times[num_std_sort_thresholds][num_american_flag_sort_thresholds];
+};
+
+template<DataTypes DataType>
+ThresholdSweep sweep_thresholds(const char * name, int num_elements)
+{
+    std::mt19937_64 randomness(77342348);
+    auto input = create_radix_sort_data<DataType>(randomness, num_elements);
+    using value_type = typename decltype(input)::value_type;
+    ThresholdSweep result;
+    result.name = name;
+    result.element_size = sizeof(value_type);
+    for (int i = 0; i < num_std_sort_thresholds; ++i)
+    {
+        for (int j = 0; j < num_american_flag_sort_thresholds; ++j)
+        {
+            TuningPolicy::std_sort_threshold = std_sort_thresholds[i];
+            TuningPolicy::american_flag_sort_threshold = american_flag_sort_thresholds[j];
+            result.times[i][j] = measure(input, [](auto & to_sort)
+            {
+                ska_sort(to_sort.begin(), to_sort.end(), detail::IdentityFunctor(), TuningPolicy());
+            });
+        }
+    }
+    std::fprintf(stderr, "%s: %zu bytes per element\n", name, result.element_size);
+    return result;
+}
+
+struct ThresholdChoice
+{
+    bool found = false;
+    std::ptrdiff_t std_sort_threshold = 0;
+    std::ptrdiff_t american_flag_sort_threshold = 0;
+};
+
+// picks the thresholds with the smallest sum of slowdowns compared to the
+// best thresholds of every data type in the size class
+static ThresholdChoice choose_thresholds(const std::vector<ThresholdSweep> & sweeps, SizeClass size)
+{
+    ThresholdChoice choice;
+    double best_score = std::numeric_limits<double>::max();
+    for (int i = 0; i < num_std_sort_thresholds; ++i)
+    {
+        for (int j = 0; j < num_american_flag_sort_thresholds; ++j)
+        {
+            double score = 0.0;
+            bool any = false;
+            for (const ThresholdSweep & sweep : sweeps)
+            {
+                if (size_class(sweep.element_size) != size)
+                    continue;
+                double best_time = std::numeric_limits<double>::max();
+                for (auto & row : sweep.times)
+                    for (double time : row)
+                        best_time = std::min(best_time, time);
+                score += sweep.times[i][j] / std::max(best_time, 1e-9);
+                any = true;
+            }
+            if (any && score < best_score)
+            {
+                best_score = score;
+                choice.found = true;
+                choice.std_sort_threshold = std_sort_thresholds[i];
+                choice.american_flag_sort_threshold = american_flag_sort_thresholds[j];
+            }
+        }
+    }
+    return choice;
+}
+
+template<typename T, size_t DigitBits>
+double measure_lsd(const std::vector<T> & input)
+{
+    std::vector<T> buffer(input.size());
+    return measure(input, [&](std::vector<T> & to_sort)
+    {
+        detail::SizedRadixSorter<sizeof(T)>::template sort_inline<std::uint32_t, DigitBits>(to_sort.begin(), to_sort.end(), buffer.begin(), buffer.end(), detail::IdentityFunctor(), detail::RadixSortSettings());
+    });
+}
+
+struct DigitWidthChoice
+{
+    std::ptrdiff_t eleven_bit_threshold;
+    std::ptrdiff_t sixteen_bit_threshold;
+};
+
+// the smallest size from which a digit width stays the fastest up to the
+// largest size measured. if it never gets there, the threshold is put just
+// past the measured range
+static std::ptrdiff_t crossover(const std::vector<std::ptrdiff_t> & sizes, const std::vector<bool> & wins)
+{
+    std::ptrdiff_t result = sizes.back() * 2;
+    for (size_t i = sizes.size(); i > 0 && wins[i - 1]; --i)
+        result = sizes[i - 1];
+    return result;
+}
+
+template<DataTypes DataType>
+DigitWidthChoice sweep_digit_widths(const char * name, std::ptrdiff_t max_elements)
+{
+    std::vector<std::ptrdiff_t> sizes;
+    std::vector<bool> eleven_wins;
+    std::vector<bool> sixteen_wins;
+    for (std::ptrdiff_t num_elements = 1 << 14; num_elements <= max_elements; num_elements *= 4)
+    {
+        std::mt19937_64 randomness(77342348);
+        auto input = create_radix_sort_data<DataType>(randomness, num_elements);
+        using value_type = typename decltype(input)::value_type;
+        double eight = measure_lsd<value_type, 8>(input);
+        double eleven = measure_lsd<value_type, (sizeof(value_type) >= 4 ? 11 : 8)>(input);
+        double sixteen = measure_lsd<value_type, 16>(input);
+        std::fprintf(stderr, "%s, %td elements: 8 bit %.3fms, 11 bit %.3fms, 16 bit %.3fms\n", name, num_elements, eight, eleven, sixteen);
+        sizes.push_back(num_elements);
+        eleven_wins.push_back(sizeof(value_type) >= 4 && eleven < eight);
+        sixteen_wins.push_back(sixteen < eight && (sizeof(value_type) < 4 || sixteen < eleven));
+    }
+    DigitWidthChoice choice;
+    choice.eleven_bit_threshold = crossover(sizes, eleven_wins);
+    choice.sixteen_bit_threshold = crossover(sizes, sixteen_wins);
+    return choice;
+}
+
+int main(int argc, char * argv[])
+{
+    const char * output_name = argc > 1 ? argv[1] : "ska_sort_tuning.hpp";
+    int num_elements = argc > 2 ? std::atoi(argv[2]) : 1 << 17;
+    std::ptrdiff_t max_lsd_elements = argc > 3 ? std::atoll(argv[3]) : 1 << 22;
+
+    std::vector<ThresholdSweep> sweeps;
+#define SWEEP_THRESHOLDS(DATA_TYPE) sweeps.push_back(sweep_thresholds<DataTypes::DATA_TYPE>(#DATA_TYPE, num_elements))
+    SWEEP_THRESHOLDS(vector_int32_t);
+    SWEEP_THRESHOLDS(vector_bool_float_pair);
+    SWEEP_THRESHOLDS(deque_bool);
+    SWEEP_THRESHOLDS(vector_uint8);
+    SWEEP_THRESHOLDS(vector_uint8_01);
+    SWEEP_THRESHOLDS(vector_uint8_geometric);
+    SWEEP_THRESHOLDS(vector_uint8_geometric_001);
+    SWEEP_THRESHOLDS(vector_uint16);
+    SWEEP_THRESHOLDS(vector_int64);
+    SWEEP_THRESHOLDS(vector_tuple_int64);
+    SWEEP_THRESHOLDS(vector_tuple_int32_int32_int64);
+    SWEEP_THRESHOLDS(vector_vector_int);
+    SWEEP_THRESHOLDS(vector_vector_string);
+    SWEEP_THRESHOLDS(vector_string);
+    SWEEP_THRESHOLDS(vector_vector_int_random_size);
+#undef SWEEP_THRESHOLDS
+
+    DigitWidthChoice two_byte_keys = sweep_digit_widths<DataTypes::vector_uint16>("vector_uint16", max_lsd_elements);
+    DigitWidthChoice four_byte_keys = sweep_digit_widths<DataTypes::vector_int32_t>("vector_int32_t", max_lsd_elements);
+    DigitWidthChoice eight_byte_keys = sweep_digit_widths<DataTypes::vector_int64>("vector_int64", max_lsd_elements);
+
+    FILE * output = std::fopen(output_name, "w");
+    if (!output)
+    {
+        std::fprintf(stderr, "couldn't open %s for writing\n", output_name);
+        return 1;
+    }
+    std::fprintf(output, "#pragma once\n\n");
+    std::fprintf(output, "// generated by ska_sort_autotune from %d elements per data type\n", num_elements);
+    std::fprintf(output, "// the best thresholds for every data type were:\n");
+    for (const ThresholdSweep & sweep : sweeps)
+    {
+        int best_i = 0;
+        int best_j = 0;
+        for (int i = 0; i < num_std_sort_thresholds; ++i)
+            for (int j = 0; j < num_american_flag_sort_thresholds; ++j)
+                if (sweep.times[i][j] < sweep.times[best_i][best_j])
+                {
+                    best_i = i;
+                    best_j = j;
+                }
+        std::fprintf(output, "//   %s: %td, %td\n", sweep.name.c_str(), std_sort_thresholds[best_i], american_flag_sort_thresholds[best_j]);
+    }
+    std::fprintf(output, "\n");
+    const char * size_names[] = { "SMALL", "MEDIUM", "LARGE" };
+    for (SizeClass size : { SizeClass::Small, SizeClass::Medium, SizeClass::Large })
+    {
+        ThresholdChoice choice = choose_thresholds(sweeps, size);
+        // no data type of this size, so keep the defaults
+        if (!choice.found)
+            continue;
+        std::fprintf(output, "#define SKA_SORT_STD_SORT_THRESHOLD_%s %td\n", size_names[static_cast<int>(size)], choice.std_sort_threshold);
+        std::fprintf(output, "#define SKA_SORT_AMERICAN_FLAG_SORT_THRESHOLD_%s %td\n", size_names[static_cast<int>(size)], choice.american_flag_sort_threshold);
+    }
+    std::fprintf(output, "#define SKA_SORT_LSD_16_BIT_THRESHOLD_2 %td\n", two_byte_keys.sixteen_bit_threshold);
+    std::fprintf(output, "#define SKA_SORT_LSD_11_BIT_THRESHOLD_4 %td\n", four_byte_keys.eleven_bit_threshold);
+    std::fprintf(output, "#define SKA_SORT_LSD_16_BIT_THRESHOLD_4 %td\n", four_byte_keys.sixteen_bit_threshold);
+    std::fprintf(output, "#define SKA_SORT_LSD_11_BIT_THRESHOLD_8 %td\n", eight_byte_keys.eleven_bit_threshold);
+    std::fprintf(output, "#define SKA_SORT_LSD_16_BIT_THRESHOLD_8 %td\n", eight_byte_keys.sixteen_bit_threshold);
+    std::fclose(output);
+    std::fprintf(stderr, "wrote %s\n", output_name);
+    return 0;
+}
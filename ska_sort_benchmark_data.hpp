@@ -0,0 +1,293 @@
+/*
+ * ska_sort_benchmark_data.hpp
+ *
+ * the input data for ska_sort_benchmarks and ska_sort_autotune
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+enum class DataTypes {
+  vector_int32_t,
+  vector_bool_float_pair,
+  deque_bool,
+  vector_uint8,
+  vector_uint8_01,
+  vector_uint8_geometric,
+  vector_uint8_geometric_001,
+  vector_uint16,
+  vector_int64,
+  vector_tuple_int64,
+  vector_tuple_int32_int32_int64,
+  vector_vector_int,
+  vector_vector_string,
+  vector_string,
+  vector_vector_int_random_size
+};
+
+template <enum DataTypes>
+auto  create_radix_sort_data(std::mt19937_64 & randomness, int size);
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_int32_t>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<int32_t> result;
+    result.reserve(size);
+    std::uniform_int_distribution<int32_t> distribution;
+    for (int i = 0; i < size; ++i)
+    {
+        result.push_back(distribution(randomness));
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_bool_float_pair>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::pair<bool, float>> result;
+    result.reserve(size);
+    std::uniform_int_distribution<int> int_distribution(0, 1);
+    std::uniform_real_distribution<float> real_distribution;
+    for (int i = 0; i < size; ++i)
+    {
+        result.emplace_back(int_distribution(randomness) != 0, real_distribution(randomness));
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::deque_bool>(std::mt19937_64 & randomness, int size)
+{
+    std::deque<bool> result;
+    std::uniform_int_distribution<int> int_distribution(0, 1);
+    for (int i = 0; i < size; ++i)
+    {
+        result.emplace_back(int_distribution(randomness) != 0);
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_uint8>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::int8_t> result;
+    result.reserve(size);
+    std::uniform_int_distribution<std::int8_t> int_distribution(-128, 127);
+    for (int i = 0; i < size; ++i)
+    {
+        result.emplace_back(int_distribution(randomness));
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_uint8_01>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::int8_t> result;
+    result.reserve(size);
+    std::uniform_int_distribution<std::int8_t> int_distribution(0, 1);
+    for (int i = 0; i < size; ++i)
+    {
+        result.emplace_back(int_distribution(randomness));
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_uint8_geometric>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::uint8_t> result;
+    result.reserve(size);
+    std::geometric_distribution<std::uint8_t> int_distribution(0.05);
+    for (int i = 0; i < size; ++i)
+    {
+        result.emplace_back(int_distribution(randomness));
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_uint8_geometric_001>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<int> result;
+    result.reserve(size);
+    std::geometric_distribution<int> int_distribution(0.001);
+    for (int i = 0; i < size; ++i)
+    {
+        result.emplace_back(int_distribution(randomness));
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_uint16>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::int16_t> result;
+    result.reserve(size);
+    std::uniform_int_distribution<std::int16_t> int_distribution(-32768, 32767);
+    for (int i = 0; i < size; ++i)
+    {
+        result.emplace_back(int_distribution(randomness));
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_int64>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::int64_t> result;
+    result.reserve(size);
+    std::uniform_int_distribution<std::int64_t> int_distribution(std::numeric_limits<int64_t>::lowest(), std::numeric_limits<int64_t>::max());
+    for (int i = 0; i < size; ++i)
+    {
+        result.emplace_back(int_distribution(randomness));
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_tuple_int64>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::tuple<std::int64_t, std::int64_t>> result;
+    result.reserve(size);
+    std::uniform_int_distribution<std::int64_t> int_distribution(std::numeric_limits<int64_t>::lowest(), std::numeric_limits<int64_t>::max());
+    for (int i = 0; i < size; ++i)
+    {
+        result.emplace_back(int_distribution(randomness), int_distribution(randomness));
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_tuple_int32_int32_int64>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::tuple<std::int32_t, std::int32_t, std::int64_t>> result;
+    result.reserve(size);
+    std::uniform_int_distribution<std::int32_t> int32_distribution(std::numeric_limits<int32_t>::lowest(), std::numeric_limits<int32_t>::max());
+    std::uniform_int_distribution<std::int64_t> int64_distribution(std::numeric_limits<int64_t>::lowest(), std::numeric_limits<int64_t>::max());
+    for (int i = 0; i < size; ++i)
+    {
+        result.emplace_back(int32_distribution(randomness), int32_distribution(randomness), int64_distribution(randomness));
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_vector_int>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::vector<int>> result;
+    result.reserve(size);
+    std::uniform_int_distribution<int> size_distribution(0, 20);
+    std::uniform_int_distribution<int> value_distribution;
+    for (int i = 0; i < size; ++i)
+    {
+        std::vector<int> to_add(size_distribution(randomness));
+        std::generate(to_add.begin(), to_add.end(), [&]{ return value_distribution(randomness); });
+        result.push_back(std::move(to_add));
+    }
+    return result;
+}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_vector_string>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::vector<std::string>> result;
+    result.reserve(size);
+    std::uniform_int_distribution<int> size_distribution(0, 10);
+    std::uniform_int_distribution<int> string_length_distribution(0, 5);
+    std::uniform_int_distribution<char> string_content_distribution('a', 'c');
+    for (int i = 0; i < size; ++i)
+    {
+        std::vector<std::string> to_add(size_distribution(randomness));
+        std::generate(to_add.begin(), to_add.end(), [&]
+        {
+#if 0
+            std::string new_string = "hello";
+            for (int i = 0, end = string_length_distribution(randomness); i != end; ++i)
+                new_string.push_back('\0');
+            std::generate(new_string.begin() + 5, new_string.end(), [&]
+            {
+                return string_content_distribution(randomness);
+            });
+#else
+            std::string new_string(string_length_distribution(randomness), '\0');
+            std::generate(new_string.begin(), new_string.end(), [&]
+            {
+                return string_content_distribution(randomness);
+            });
+#endif
+            return new_string;
+        });
+        result.push_back(std::move(to_add));
+    }
+    return result;
+}
+
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_string>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::string> result;
+    result.reserve(size);
+    std::uniform_int_distribution<int> string_length_distribution(0, 20);
+    std::uniform_int_distribution<char> string_content_distribution('a', 'z');
+    for (int i = 0; i < size; ++i)
+    {
+        std::string to_add(string_length_distribution(randomness), '\0');
+        std::generate(to_add.begin(), to_add.end(), [&]
+        {
+            return string_content_distribution(randomness);
+        });
+        result.push_back(std::move(to_add));
+    }
+    return result;
+}
+
+
+
+//extern const std::vector<const char *> & get_word_list();
+//
+//static std::vector<std::string> SKA_SORT_NOINLINE create_radix_sort_data(std::mt19937_64 & randomness, int size)
+//{
+//    const std::vector<const char *> & words = get_word_list();
+//    std::vector<std::string> result;
+//    result.reserve(size);
+//    std::uniform_int_distribution<int> string_length_distribution(0, 10);
+//    //std::uniform_int_distribution<int> string_length_distribution(1, 3);
+//    std::uniform_int_distribution<size_t> word_picker(0, words.size() - 1);
+//    for (int i = 0; i < size; ++i)
+//    {
+//        std::string to_add;
+//        for (int i = 0, end = string_length_distribution(randomness); i < end; ++i)
+//        {
+//            to_add += words[word_picker(randomness)];
+//        }
+//        result.push_back(std::move(to_add));
+//    }
+//    return result;
+//}
+
+template <>
+inline auto create_radix_sort_data<DataTypes::vector_vector_int_random_size>(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::vector<int>> result;
+    std::uniform_int_distribution<int> random_size(0, 128);
+    result.reserve(size);
+    for (int i = 0; i < size; ++i)
+    {
+        std::vector<int> to_add(random_size(randomness));
+        std::iota(to_add.begin(), to_add.end(), 0);
+        result.push_back(std::move(to_add));
+    }
+    return result;
+}
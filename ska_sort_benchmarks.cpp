@@ -6,6 +6,7 @@
  */
 
 #include "ska_sort.hpp"
+#include "ska_sort_benchmark_data.hpp"
 #include "benchmark/benchmark.h"
 
 #include <random>
@@ -19,280 +20,6 @@
 
 #define SKA_SORT_NOINLINE __attribute__((noinline))
 
-enum class DataTypes {
-  vector_int32_t,
-  vector_bool_float_pair,
-  deque_bool,
-  vector_uint8,
-  vector_uint8_01,
-  vector_uint8_geometric,
-  vector_uint8_geometric_001,
-  vector_uint16,
-  vector_int64,
-  vector_tuple_int64,
-  vector_tuple_int32_int32_int64,
-  vector_vector_int,
-  vector_vector_string,
-  vector_string,
-  vector_vector_int_random_size
-};
-
-template <enum DataTypes>
-auto  create_radix_sort_data(std::mt19937_64 & randomness, int size);
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_int32_t>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<int32_t> result;
-    result.reserve(size);
-    std::uniform_int_distribution<int32_t> distribution;
-    for (int i = 0; i < size; ++i)
-    {
-        result.push_back(distribution(randomness));
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_bool_float_pair>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::pair<bool, float>> result;
-    result.reserve(size);
-    std::uniform_int_distribution<int> int_distribution(0, 1);
-    std::uniform_real_distribution<float> real_distribution;
-    for (int i = 0; i < size; ++i)
-    {
-        result.emplace_back(int_distribution(randomness) != 0, real_distribution(randomness));
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::deque_bool>(std::mt19937_64 & randomness, int size)
-{
-    std::deque<bool> result;
-    std::uniform_int_distribution<int> int_distribution(0, 1);
-    for (int i = 0; i < size; ++i)
-    {
-        result.emplace_back(int_distribution(randomness) != 0);
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_uint8>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::int8_t> result;
-    result.reserve(size);
-    std::uniform_int_distribution<std::int8_t> int_distribution(-128, 127);
-    for (int i = 0; i < size; ++i)
-    {
-        result.emplace_back(int_distribution(randomness));
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_uint8_01>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::int8_t> result;
-    result.reserve(size);
-    std::uniform_int_distribution<std::int8_t> int_distribution(0, 1);
-    for (int i = 0; i < size; ++i)
-    {
-        result.emplace_back(int_distribution(randomness));
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_uint8_geometric>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::uint8_t> result;
-    result.reserve(size);
-    std::geometric_distribution<std::uint8_t> int_distribution(0.05);
-    for (int i = 0; i < size; ++i)
-    {
-        result.emplace_back(int_distribution(randomness));
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_uint8_geometric_001>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<int> result;
-    result.reserve(size);
-    std::geometric_distribution<int> int_distribution(0.001);
-    for (int i = 0; i < size; ++i)
-    {
-        result.emplace_back(int_distribution(randomness));
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_uint16>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::int16_t> result;
-    result.reserve(size);
-    std::uniform_int_distribution<std::int16_t> int_distribution(-32768, 32767);
-    for (int i = 0; i < size; ++i)
-    {
-        result.emplace_back(int_distribution(randomness));
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_int64>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::int64_t> result;
-    result.reserve(size);
-    std::uniform_int_distribution<std::int64_t> int_distribution(std::numeric_limits<int64_t>::lowest(), std::numeric_limits<int64_t>::max());
-    for (int i = 0; i < size; ++i)
-    {
-        result.emplace_back(int_distribution(randomness));
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_tuple_int64>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::tuple<std::int64_t, std::int64_t>> result;
-    result.reserve(size);
-    std::uniform_int_distribution<std::int64_t> int_distribution(std::numeric_limits<int64_t>::lowest(), std::numeric_limits<int64_t>::max());
-    for (int i = 0; i < size; ++i)
-    {
-        result.emplace_back(int_distribution(randomness), int_distribution(randomness));
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_tuple_int32_int32_int64>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::tuple<std::int32_t, std::int32_t, std::int64_t>> result;
-    result.reserve(size);
-    std::uniform_int_distribution<std::int32_t> int32_distribution(std::numeric_limits<int32_t>::lowest(), std::numeric_limits<int32_t>::max());
-    std::uniform_int_distribution<std::int64_t> int64_distribution(std::numeric_limits<int64_t>::lowest(), std::numeric_limits<int64_t>::max());
-    for (int i = 0; i < size; ++i)
-    {
-        result.emplace_back(int32_distribution(randomness), int32_distribution(randomness), int64_distribution(randomness));
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_vector_int>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::vector<int>> result;
-    result.reserve(size);
-    std::uniform_int_distribution<int> size_distribution(0, 20);
-    std::uniform_int_distribution<int> value_distribution;
-    for (int i = 0; i < size; ++i)
-    {
-        std::vector<int> to_add(size_distribution(randomness));
-        std::generate(to_add.begin(), to_add.end(), [&]{ return value_distribution(randomness); });
-        result.push_back(std::move(to_add));
-    }
-    return result;
-}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_vector_string>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::vector<std::string>> result;
-    result.reserve(size);
-    std::uniform_int_distribution<int> size_distribution(0, 10);
-    std::uniform_int_distribution<int> string_length_distribution(0, 5);
-    std::uniform_int_distribution<char> string_content_distribution('a', 'c');
-    for (int i = 0; i < size; ++i)
-    {
-        std::vector<std::string> to_add(size_distribution(randomness));
-        std::generate(to_add.begin(), to_add.end(), [&]
-        {
-#if 0
-            std::string new_string = "hello";
-            for (int i = 0, end = string_length_distribution(randomness); i != end; ++i)
-                new_string.push_back('\0');
-            std::generate(new_string.begin() + 5, new_string.end(), [&]
-            {
-                return string_content_distribution(randomness);
-            });
-#else
-            std::string new_string(string_length_distribution(randomness), '\0');
-            std::generate(new_string.begin(), new_string.end(), [&]
-            {
-                return string_content_distribution(randomness);
-            });
-#endif
-            return new_string;
-        });
-        result.push_back(std::move(to_add));
-    }
-    return result;
-}
-
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_string>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::string> result;
-    result.reserve(size);
-    std::uniform_int_distribution<int> string_length_distribution(0, 20);
-    std::uniform_int_distribution<char> string_content_distribution('a', 'z');
-    for (int i = 0; i < size; ++i)
-    {
-        std::string to_add(string_length_distribution(randomness), '\0');
-        std::generate(to_add.begin(), to_add.end(), [&]
-        {
-            return string_content_distribution(randomness);
-        });
-        result.push_back(std::move(to_add));
-    }
-    return result;
-}
-
-
-
-//extern const std::vector<const char *> & get_word_list();
-//
-//static std::vector<std::string> SKA_SORT_NOINLINE create_radix_sort_data(std::mt19937_64 & randomness, int size)
-//{
-//    const std::vector<const char *> & words = get_word_list();
-//    std::vector<std::string> result;
-//    result.reserve(size);
-//    std::uniform_int_distribution<int> string_length_distribution(0, 10);
-//    //std::uniform_int_distribution<int> string_length_distribution(1, 3);
-//    std::uniform_int_distribution<size_t> word_picker(0, words.size() - 1);
-//    for (int i = 0; i < size; ++i)
-//    {
-//        std::string to_add;
-//        for (int i = 0, end = string_length_distribution(randomness); i < end; ++i)
-//        {
-//            to_add += words[word_picker(randomness)];
-//        }
-//        result.push_back(std::move(to_add));
-//    }
-//    return result;
-//}
-
-template <>
-auto create_radix_sort_data<DataTypes::vector_vector_int_random_size>(std::mt19937_64 & randomness, int size)
-{
-    std::vector<std::vector<int>> result;
-    std::uniform_int_distribution<int> random_size(0, 128);
-    result.reserve(size);
-    for (int i = 0; i < size; ++i)
-    {
-        std::vector<int> to_add(random_size(randomness));
-        std::iota(to_add.begin(), to_add.end(), 0);
-        result.push_back(std::move(to_add));
-    }
-    return result;
-}
 //
 //template<size_t Size>
 //struct SizedStruct
@@ -370,6 +97,40 @@ void benchmark_radix_sort_copy(benchmark::State & state)
 }
 
 
+template <enum DataTypes val>
+void benchmark_parallel_radix_sort_copy(benchmark::State & state)
+{
+    std::mt19937_64 randomness(77342348);
+    auto to_sort = create_radix_sort_data<val>(randomness, state.range(0));
+    typedef decltype(to_sort) cont;
+    cont buffer(to_sort.size());
+    benchmark::DoNotOptimize(buffer.data());
+    for (auto _ : state)
+    {
+        parallel_radix_sort(to_sort.begin(), to_sort.end(), buffer.begin());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * to_sort.size());
+    state.SetBytesProcessed(state.iterations() * to_sort.size() * sizeof(typename cont::value_type));
+}
+
+template <enum DataTypes val>
+void benchmark_write_combining_radix_sort_copy(benchmark::State & state)
+{
+    std::mt19937_64 randomness(77342348);
+    auto to_sort = create_radix_sort_data<val>(randomness, state.range(0));
+    typedef decltype(to_sort) cont;
+    cont buffer(to_sort.size());
+    benchmark::DoNotOptimize(buffer.data());
+    for (auto _ : state)
+    {
+        write_combining_radix_sort(to_sort.begin(), to_sort.end(), buffer.begin());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * to_sort.size());
+    state.SetBytesProcessed(state.iterations() * to_sort.size() * sizeof(typename cont::value_type));
+}
+
 template <enum DataTypes val>
 void benchmark_ska_sort_copy(benchmark::State & state)
 {
@@ -449,6 +210,64 @@ static void benchmark_ska_sort(benchmark::State & state)
   state.SetBytesProcessed(state.iterations() * to_sort.size() * sizeof(typename cont::value_type));
 }
 
+template <enum DataTypes val>
+static void benchmark_ska_argsort(benchmark::State & state)
+{
+  std::mt19937_64 randomness(77342348);
+  auto to_sort = create_radix_sort_data<val>(randomness, state.range(0));
+  std::vector<std::uint32_t> indices(to_sort.size());
+  for (auto _ : state)
+  {
+      ska_argsort(to_sort.begin(), to_sort.end(), indices.begin());
+      benchmark::DoNotOptimize(indices.data());
+      benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * to_sort.size());
+}
+
+// the argsort that ska_argsort replaces: sort pairs of key and index
+template <enum DataTypes val>
+static void benchmark_ska_sort_index_pairs(benchmark::State & state)
+{
+  std::mt19937_64 randomness(77342348);
+  auto to_sort = create_radix_sort_data<val>(randomness, state.range(0));
+  std::vector<std::pair<typename decltype(to_sort)::value_type, std::uint32_t>> pairs;
+  std::vector<std::uint32_t> indices(to_sort.size());
+  for (auto _ : state)
+  {
+      pairs.clear();
+      for (size_t i = 0; i < to_sort.size(); ++i)
+          pairs.emplace_back(to_sort[i], static_cast<std::uint32_t>(i));
+      ska_sort(pairs.begin(), pairs.end(), [](const auto & pair) -> decltype(auto){ return pair.first; });
+      for (size_t i = 0; i < pairs.size(); ++i)
+          indices[i] = pairs[i].second;
+      benchmark::DoNotOptimize(indices.data());
+      benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * to_sort.size());
+}
+
+template <enum DataTypes val>
+static void benchmark_parallel_ska_sort(benchmark::State & state)
+{
+  std::mt19937_64 randomness(77342348);
+  auto to_sort = create_radix_sort_data<val>(randomness, state.range(0));
+  typedef decltype(to_sort) cont;
+  cont buffer(to_sort.size());
+  benchmark::DoNotOptimize(buffer.data());
+  buffer.clear();
+  for (auto _ : state)
+  {
+      buffer = to_sort;
+      benchmark::DoNotOptimize(buffer.data());
+      parallel_ska_sort(buffer.begin(), buffer.end());
+      benchmark::ClobberMemory();
+      buffer.clear();
+  }
+  state.SetItemsProcessed(state.iterations() * to_sort.size());
+  state.SetBytesProcessed(state.iterations() * to_sort.size() * sizeof(typename cont::value_type));
+}
+
 template <enum DataTypes val>
 static void benchmark_std_sort(benchmark::State & state)
 {
@@ -494,6 +313,184 @@ static void benchmark_american_flag_sort(benchmark::State & state)
 
 
 
+// records of Size bytes with a 64 bit key in front. used to pick
+// SKA_SORT_KEY_INDEX_THRESHOLD and SKA_SORT_RADIX_SORT_KEY_INDEX_THRESHOLD
+template<size_t Size>
+struct SizedRecord
+{
+    std::uint64_t key;
+    std::uint8_t payload[Size - sizeof(std::uint64_t)];
+};
+template<size_t Size>
+static std::vector<SizedRecord<Size>> SKA_SORT_NOINLINE create_sized_records(std::mt19937_64 & randomness, int size)
+{
+    std::vector<SizedRecord<Size>> result(size);
+    for (SizedRecord<Size> & record : result)
+        record.key = randomness();
+    return result;
+}
+template<size_t Size>
+static void benchmark_ska_sort_records(benchmark::State & state)
+{
+    std::mt19937_64 randomness(77342348);
+    auto to_sort = create_sized_records<Size>(randomness, state.range(0));
+    auto buffer = to_sort;
+    for (auto _ : state)
+    {
+        buffer = to_sort;
+        benchmark::DoNotOptimize(buffer.data());
+        ska_sort(buffer.begin(), buffer.end(), [](const SizedRecord<Size> & record){ return record.key; });
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * to_sort.size());
+}
+template<size_t Size>
+static void benchmark_radix_sort_records(benchmark::State & state)
+{
+    std::mt19937_64 randomness(77342348);
+    auto to_sort = create_sized_records<Size>(randomness, state.range(0));
+    auto buffer = to_sort;
+    auto result = to_sort;
+    for (auto _ : state)
+    {
+        buffer = to_sort;
+        benchmark::DoNotOptimize(buffer.data());
+        radix_sort(buffer.begin(), buffer.end(), result.begin(), [](const SizedRecord<Size> & record){ return record.key; });
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * to_sort.size());
+}
+
+// a table with a key column and two payload columns. sorting the columns
+// directly against zipping them into tuples, sorting and unzipping
+struct ColumnTable
+{
+    std::vector<std::int64_t> keys;
+    std::vector<std::int64_t> first;
+    std::vector<double> second;
+};
+static ColumnTable SKA_SORT_NOINLINE create_column_table(std::mt19937_64 & randomness, int size)
+{
+    ColumnTable result;
+    for (int i = 0; i < size; ++i)
+    {
+        result.keys.push_back(static_cast<std::int64_t>(randomness()));
+        result.first.push_back(i);
+        result.second.push_back(i);
+    }
+    return result;
+}
+static void benchmark_ska_sort_columns(benchmark::State & state)
+{
+    std::mt19937_64 randomness(77342348);
+    ColumnTable table = create_column_table(randomness, state.range(0));
+    ColumnTable to_sort = table;
+    for (auto _ : state)
+    {
+        to_sort = table;
+        ska_sort_columns(to_sort.keys.begin(), to_sort.keys.end(), to_sort.first.begin(), to_sort.second.begin());
+        benchmark::DoNotOptimize(to_sort.keys.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * table.keys.size());
+}
+static void benchmark_ska_sort_zipped_columns(benchmark::State & state)
+{
+    std::mt19937_64 randomness(77342348);
+    ColumnTable table = create_column_table(randomness, state.range(0));
+    ColumnTable to_sort = table;
+    std::vector<std::tuple<std::int64_t, std::int64_t, double>> rows;
+    for (auto _ : state)
+    {
+        to_sort = table;
+        rows.clear();
+        for (size_t i = 0; i < to_sort.keys.size(); ++i)
+            rows.emplace_back(to_sort.keys[i], to_sort.first[i], to_sort.second[i]);
+        ska_sort(rows.begin(), rows.end(), [](const auto & row){ return std::get<0>(row); });
+        for (size_t i = 0; i < rows.size(); ++i)
+            std::tie(to_sort.keys[i], to_sort.first[i], to_sort.second[i]) = rows[i];
+        benchmark::DoNotOptimize(to_sort.keys.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * table.keys.size());
+}
+
+template <enum DataTypes val>
+static void benchmark_stable_ska_sort(benchmark::State & state)
+{
+  std::mt19937_64 randomness(77342348);
+  auto to_sort = create_radix_sort_data<val>(randomness, state.range(0));
+  auto buffer = to_sort;
+  for (auto _ : state)
+  {
+      buffer = to_sort;
+      benchmark::DoNotOptimize(buffer.data());
+      stable_ska_sort(buffer.begin(), buffer.end(), [](const auto & value) -> decltype(auto){ return value; });
+      benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * to_sort.size());
+}
+template <enum DataTypes val>
+static void benchmark_stable_ska_sort_copy(benchmark::State & state)
+{
+  std::mt19937_64 randomness(77342348);
+  auto to_sort = create_radix_sort_data<val>(randomness, state.range(0));
+  auto input = to_sort;
+  auto buffer = to_sort;
+  for (auto _ : state)
+  {
+      input = to_sort;
+      benchmark::DoNotOptimize(input.data());
+      stable_ska_sort_copy(input.begin(), input.end(), buffer.begin());
+      benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * to_sort.size());
+}
+
+template <enum DataTypes val>
+static void benchmark_std_stable_sort(benchmark::State & state)
+{
+  std::mt19937_64 randomness(77342348);
+  auto to_sort = create_radix_sort_data<val>(randomness, state.range(0));
+  auto buffer = to_sort;
+  for (auto _ : state)
+  {
+      buffer = to_sort;
+      benchmark::DoNotOptimize(buffer.data());
+      std::stable_sort(buffer.begin(), buffer.end());
+      benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * to_sort.size());
+}
+
+// strings that share a long prefix, like paths in a log. fewer than the
+// cached string sort takes, so every level looks for the common prefix
+static std::vector<std::string> SKA_SORT_NOINLINE create_prefixed_strings(std::mt19937_64 & randomness, int size)
+{
+    std::vector<std::string> result;
+    for (int i = 0; i < size; ++i)
+    {
+        std::string path = "/api/v2/customers/" + std::to_string(randomness() % 4) + "/orders/history/";
+        path += std::to_string(randomness() % 1000);
+        result.push_back(std::move(path));
+    }
+    return result;
+}
+static void benchmark_ska_sort_prefixed_strings(benchmark::State & state)
+{
+    std::mt19937_64 randomness(77342348);
+    auto to_sort = create_prefixed_strings(randomness, state.range(0));
+    auto buffer = to_sort;
+    for (auto _ : state)
+    {
+        buffer = to_sort;
+        benchmark::DoNotOptimize(buffer.data());
+        ska_sort(buffer.begin(), buffer.end());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * to_sort.size());
+}
+
 template <enum DataTypes val>
 static void benchmark_generation(benchmark::State & state)
 {
@@ -595,6 +592,22 @@ BENCHMARK_SUITE(DataTypes::vector_uint8_geometric_001)
 BENCHMARK_SUITE(DataTypes::vector_uint16)
 BENCHMARK_SUITE(DataTypes::vector_int64)
 
+// compares the direct scatter against the write combining one. the sizes go
+// up to well beyond the last level cache to show where the crossover is
+#define SCATTER_RANGE_ARGS() RangeMultiplier(4)->Range(1 << 10, 1 << 26)
+#define SCATTER_BENCHMARK_SUITE(DATA_TYPE) \
+BENCHMARK_TEMPLATE(benchmark_radix_sort_copy, DATA_TYPE)->SCATTER_RANGE_ARGS(); \
+BENCHMARK_TEMPLATE(benchmark_write_combining_radix_sort_copy, DATA_TYPE)->SCATTER_RANGE_ARGS();
+SCATTER_BENCHMARK_SUITE(DataTypes::vector_int32_t)
+SCATTER_BENCHMARK_SUITE(DataTypes::vector_int64)
+
+#define PARALLEL_RANGE_ARGS() RangeMultiplier(4)->Range(1 << 16, 1 << 26)->UseRealTime()
+BENCHMARK_TEMPLATE(benchmark_parallel_ska_sort, DataTypes::vector_int32_t)->PARALLEL_RANGE_ARGS();
+BENCHMARK_TEMPLATE(benchmark_parallel_ska_sort, DataTypes::vector_int64)->PARALLEL_RANGE_ARGS();
+BENCHMARK_TEMPLATE(benchmark_parallel_ska_sort, DataTypes::vector_tuple_int64)->PARALLEL_RANGE_ARGS();
+BENCHMARK_TEMPLATE(benchmark_parallel_radix_sort_copy, DataTypes::vector_int32_t)->PARALLEL_RANGE_ARGS();
+BENCHMARK_TEMPLATE(benchmark_parallel_radix_sort_copy, DataTypes::vector_int64)->PARALLEL_RANGE_ARGS();
+
 
 REDUCED_BENCHMARK_SUITE(DataTypes::vector_tuple_int64)
 REDUCED_BENCHMARK_SUITE(DataTypes::vector_tuple_int32_int32_int64)
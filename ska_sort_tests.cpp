@@ -6,6 +6,9 @@
  */
 
 #include <vector>
+#include <random>
+#include <cmath>
+#include <deque>
 #include "ska_sort.hpp"
 #include <gtest/gtest.h>
 
@@ -27,6 +30,19 @@ TEST(counting_sort, string)
     ASSERT_EQ(to_sort, result);
 }
 
+TEST(counting_sort, many_repeats)
+{
+    // big enough to count into several histograms, with a leftover tail
+    std::mt19937_64 randomness(77342348);
+    std::vector<uint8_t> to_sort(10003);
+    for (uint8_t & i : to_sort)
+        i = randomness() % 3 * 100;
+    std::vector<uint8_t> result(to_sort.size());
+    counting_sort(to_sort.begin(), to_sort.end(), result.begin());
+    std::sort(to_sort.begin(), to_sort.end());
+    ASSERT_EQ(to_sort, result);
+}
+
 TEST(radix_sort, uint8)
 {
     std::vector<uint8_t> to_sort = { 5, 6, 19, 2, 5, 0, 7, 23, 6, 255, 8, 99 };
@@ -42,13 +58,10 @@ TEST(radix_sort, uint8_256_items)
 {
     std::vector<uint8_t> to_sort(256, 254);
     to_sort.back() = 255;
+    std::vector<uint8_t> copy = to_sort;
     std::vector<uint8_t> result(to_sort.size());
     bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](auto i){ return i; });
-    if (which_buffer)
-        std::sort(to_sort.begin(), to_sort.end());
-    else
-        std::sort(result.begin(), result.end());
-    ASSERT_EQ(to_sort, result);
+    ASSERT_EQ(copy, which_buffer ? result : to_sort);
 }
 TEST(radix_sort, int8)
 {
@@ -160,6 +173,250 @@ TEST(radix_sort, uint64)
         std::sort(result.begin(), result.end());
     ASSERT_EQ(result, to_sort);
 }
+TEST(radix_sort, int64_small_range)
+{
+    // only the lowest two bytes differ, so most passes get skipped
+    std::vector<int64_t> to_sort = { 1500000000005, 1500000000600, 1500000000019, 1500000000002, 1500000000005, 1500000060000, 1500000000007, 1500000000023, 1500000000006 };
+    std::vector<int64_t> result(to_sort.size());
+    bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](auto i){ return i; });
+    if (which_buffer)
+        std::sort(to_sort.begin(), to_sort.end());
+    else
+        std::sort(result.begin(), result.end());
+    ASSERT_EQ(result, to_sort);
+}
+TEST(radix_sort, uint16_many_repeats)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<uint16_t> to_sort(10003);
+    for (uint16_t & i : to_sort)
+        i = randomness() % 5 * 0x0101;
+    std::vector<uint16_t> result(to_sort.size());
+    bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin());
+    if (which_buffer)
+        std::sort(to_sort.begin(), to_sort.end());
+    else
+        std::sort(result.begin(), result.end());
+    ASSERT_EQ(result, to_sort);
+}
+TEST(radix_sort, uint32_eleven_bit_digits)
+{
+    // big enough to sort in three passes of eleven bits
+    std::mt19937_64 randomness(77342348);
+    std::vector<uint32_t> to_sort(300007);
+    for (uint32_t & i : to_sort)
+        i = static_cast<uint32_t>(randomness());
+    std::vector<uint32_t> result(to_sort.size());
+    bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin());
+    ASSERT_TRUE(which_buffer);
+    std::sort(to_sort.begin(), to_sort.end());
+    ASSERT_EQ(result, to_sort);
+}
+TEST(radix_sort, int64_sixteen_bit_digits)
+{
+    // big enough to sort in four passes of sixteen bits
+    std::mt19937_64 randomness(77342348);
+    std::vector<int64_t> to_sort(1 << 22);
+    for (int64_t & i : to_sort)
+        i = static_cast<int64_t>(randomness());
+    std::vector<int64_t> result(to_sort.size());
+    bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin());
+    ASSERT_FALSE(which_buffer);
+    std::sort(result.begin(), result.end());
+    ASSERT_EQ(result, to_sort);
+}
+TEST(radix_sort, stable_with_wide_digits)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::pair<uint32_t, int>> to_sort(300007);
+    for (size_t i = 0; i < to_sort.size(); ++i)
+        to_sort[i] = { static_cast<uint32_t>(randomness() % 1000) * 0x10001u, static_cast<int>(i) };
+    std::vector<std::pair<uint32_t, int>> result(to_sort.size());
+    bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](auto && p){ return p.first; });
+    if (which_buffer)
+        to_sort.swap(result);
+    ASSERT_TRUE(std::is_sorted(to_sort.begin(), to_sort.end()));
+}
+TEST(radix_sort, odd_number_of_passes)
+{
+    // the second byte is the same everywhere, so an odd number of passes remains
+    std::vector<uint32_t> to_sort = { 0x01000005, 0x02010004, 0x03000003, 0x04020002, 0x01000001, 0x05010000 };
+    std::vector<uint32_t> result(to_sort.size());
+    bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](auto i){ return i; });
+    ASSERT_TRUE(which_buffer);
+    std::sort(to_sort.begin(), to_sort.end());
+    ASSERT_EQ(result, to_sort);
+}
+TEST(radix_sort, all_equal)
+{
+    std::vector<int32_t> to_sort(10, -7);
+    std::vector<int32_t> result(to_sort.size());
+    bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](auto i){ return i; });
+    ASSERT_FALSE(which_buffer);
+    ASSERT_EQ(std::vector<int32_t>(10, -7), to_sort);
+}
+#ifdef SKA_SORT_INT128
+TEST(radix_sort, int128)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<__int128> to_sort(10000);
+    std::generate(to_sort.begin(), to_sort.end(), [&]{ return static_cast<__int128>((static_cast<unsigned __int128>(randomness()) << 64) | randomness()); });
+    std::vector<__int128> result(to_sort.size());
+    std::vector<__int128> copy = to_sort;
+    bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin());
+    std::sort(copy.begin(), copy.end());
+    ASSERT_TRUE(copy == (which_buffer ? result : to_sort));
+}
+#endif
+TEST(radix_sort, byte_arrays)
+{
+    std::mt19937_64 randomness(77342348);
+    auto test = [&](auto array)
+    {
+        using array_type = decltype(array);
+        std::vector<std::pair<array_type, int>> to_sort;
+        for (int i = 0; i < 10000; ++i)
+        {
+            // only a few different first bytes, so that the later bytes matter
+            for (size_t j = 0; j < array.size(); ++j)
+                array[j] = static_cast<unsigned char>(j == 0 ? randomness() % 4 : randomness());
+            to_sort.emplace_back(array, i);
+            if (i % 3 == 0)
+                to_sort.emplace_back(array, -i);
+        }
+        std::vector<std::pair<array_type, int>> result(to_sort.size());
+        std::vector<std::pair<array_type, int>> copy = to_sort;
+        auto extract_key = [](const std::pair<array_type, int> & p) -> const array_type &{ return p.first; };
+        bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin(), extract_key);
+        std::stable_sort(copy.begin(), copy.end(), [](const std::pair<array_type, int> & l, const std::pair<array_type, int> & r){ return l.first < r.first; });
+        ASSERT_EQ(copy, which_buffer ? result : to_sort);
+    };
+    test(std::array<uint8_t, 1>());
+    test(std::array<uint8_t, 3>());
+    test(std::array<uint8_t, 5>());
+    test(std::array<uint8_t, 16>());
+    test(std::array<uint8_t, 20>());
+}
+TEST(radix_sort, presorted)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<int32_t> sorted(10000);
+    std::generate(sorted.begin(), sorted.end(), [&]{ return static_cast<int32_t>(randomness() % 1000); });
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<int32_t> reversed(sorted.rbegin(), sorted.rend());
+    reversed.erase(std::unique(reversed.begin(), reversed.end()), reversed.end());
+    std::vector<int32_t> with_tail = sorted;
+    for (int i = 0; i < 100; ++i)
+        with_tail.push_back(static_cast<int32_t>(randomness() % 1000));
+    for (std::vector<int32_t> to_sort : { sorted, reversed, with_tail })
+    {
+        std::vector<int32_t> copy = to_sort;
+        std::vector<int32_t> result(to_sort.size());
+        bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](int32_t i){ return i; });
+        std::sort(copy.begin(), copy.end());
+        ASSERT_EQ(copy, which_buffer ? result : to_sort);
+    }
+}
+TEST(radix_sort, presorted_stable)
+{
+    // the tail has keys that are already in the sorted part, and those
+    // have to end up after them
+    std::vector<std::pair<int, int>> to_sort;
+    for (int i = 0; i < 1000; ++i)
+        to_sort.emplace_back(i / 10, i);
+    for (int i = 0; i < 50; ++i)
+        to_sort.emplace_back((50 - i) * 2, 1000 + i);
+    std::vector<std::pair<int, int>> copy = to_sort;
+    std::vector<std::pair<int, int>> result(to_sort.size());
+    bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](const std::pair<int, int> & p){ return p.first; });
+    std::stable_sort(copy.begin(), copy.end(), [](const std::pair<int, int> & l, const std::pair<int, int> & r){ return l.first < r.first; });
+    ASSERT_EQ(copy, which_buffer ? result : to_sort);
+}
+TEST(radix_sort, presorted_nan)
+{
+    // no element is less than the NaN, so operator< would call this sorted
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    std::vector<double> to_sort = { 3.0, nan, 1.0, 2.0 };
+    std::vector<double> result(to_sort.size());
+    bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](double d){ return d; });
+    std::vector<double> & sorted = which_buffer ? result : to_sort;
+    ASSERT_EQ(1.0, sorted[0]);
+    ASSERT_EQ(2.0, sorted[1]);
+    ASSERT_EQ(3.0, sorted[2]);
+    ASSERT_TRUE(std::isnan(sorted[3]));
+}
+struct RadixKeyOnly
+{
+    long cents;
+};
+long to_radix_sort_key(const RadixKeyOnly & money)
+{
+    return money.cents;
+}
+TEST(radix_sort, presorted_radix_key_only)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::pair<RadixKeyOnly, int>> sorted;
+    for (int i = 0; i < 1000; ++i)
+        sorted.emplace_back(RadixKeyOnly{ i / 10 - 50 }, i);
+    std::vector<std::pair<RadixKeyOnly, int>> with_tail = sorted;
+    for (int i = 0; i < 50; ++i)
+        with_tail.emplace_back(RadixKeyOnly{ static_cast<long>(randomness() % 100) - 50 }, 1000 + i);
+    std::vector<std::pair<RadixKeyOnly, int>> reversed(sorted.rbegin(), sorted.rend());
+    reversed.erase(std::unique(reversed.begin(), reversed.end(), [](auto && l, auto && r){ return l.first.cents == r.first.cents; }), reversed.end());
+    std::vector<std::pair<RadixKeyOnly, int>> shuffled = sorted;
+    std::shuffle(shuffled.begin(), shuffled.end(), randomness);
+    for (std::vector<std::pair<RadixKeyOnly, int>> to_sort : { sorted, with_tail, reversed, shuffled })
+    {
+        std::vector<std::pair<RadixKeyOnly, int>> copy = to_sort;
+        std::vector<std::pair<RadixKeyOnly, int>> result(to_sort.size());
+        bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](auto && p) -> const RadixKeyOnly &{ return p.first; });
+        std::stable_sort(copy.begin(), copy.end(), [](auto && l, auto && r){ return l.first.cents < r.first.cents; });
+        std::vector<std::pair<RadixKeyOnly, int>> & sorted_result = which_buffer ? result : to_sort;
+        for (size_t i = 0; i < copy.size(); ++i)
+            ASSERT_EQ(copy[i].second, sorted_result[i].second);
+    }
+}
+TEST(write_combining_radix_sort, int64)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<int64_t> to_sort(10000);
+    std::generate(to_sort.begin(), to_sort.end(), [&]{ return static_cast<int64_t>(randomness()); });
+    std::vector<int64_t> result(to_sort.size());
+    bool which_buffer = write_combining_radix_sort(to_sort.begin(), to_sort.end(), result.begin());
+    if (which_buffer)
+        std::sort(to_sort.begin(), to_sort.end());
+    else
+        std::sort(result.begin(), result.end());
+    ASSERT_EQ(result, to_sort);
+}
+TEST(write_combining_radix_sort, stable_pair)
+{
+    std::mt19937_64 randomness(77342348);
+    std::uniform_int_distribution<int> distribution(-1000, 1000);
+    std::vector<std::pair<int16_t, int>> to_sort;
+    for (int i = 0; i < 10000; ++i)
+        to_sort.emplace_back(distribution(randomness), i);
+    std::vector<std::pair<int16_t, int>> result(to_sort.size());
+    bool which_buffer = write_combining_radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](auto && p){ return p.first; });
+    std::vector<std::pair<int16_t, int>> & sorted = which_buffer ? result : to_sort;
+    std::vector<std::pair<int16_t, int>> & other = which_buffer ? to_sort : result;
+    std::sort(other.begin(), other.end());
+    ASSERT_EQ(other, sorted);
+}
+TEST(write_combining_radix_sort, empty_last_buckets)
+{
+    // small values leave the high buckets of every pass empty. their slots
+    // are past the end of the output
+    std::mt19937_64 randomness(77342348);
+    std::vector<uint32_t> to_sort(10000);
+    std::generate(to_sort.begin(), to_sort.end(), [&]{ return static_cast<uint32_t>(randomness() % 100000); });
+    std::vector<uint32_t> copy = to_sort;
+    std::vector<uint32_t> result(to_sort.size());
+    bool which_buffer = write_combining_radix_sort(to_sort.begin(), to_sort.end(), result.begin());
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, which_buffer ? result : to_sort);
+}
 TEST(radix_sort, float)
 {
     std::vector<float> to_sort = { 5, 6, 19, std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -4, 2, 5, 0, -55, 7, 1000, 23, 6, 8, 127, -128, -129, -256, 32768, -32769, -32768, 32767, 99, 1000000, -1000001, 0.1f, 2.5f, 17.8f, -12.4f, -0.0000002f, -0.0f, -777777777.7f, 444444444444.4f };
@@ -818,6 +1075,894 @@ TEST(inplace_radix_sort, no_copy)
     ASSERT_TRUE(std::is_sorted(to_sort.begin(), to_sort.end(), sort_by_last_name));
 }
 
+TEST(ska_sort_policy, insertion_sort)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<int32_t> to_sort(100000);
+    std::generate(to_sort.begin(), to_sort.end(), [&]{ return static_cast<int32_t>(randomness()); });
+    std::vector<int32_t> copy = to_sort;
+    ska_sort(to_sort.begin(), to_sort.end(), [](int32_t i){ return i; }, ska_sort_policy<16, 256, 16, insertion_sort_small_sort>());
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, to_sort);
+}
+TEST(ska_sort_policy, list_recursion_limit)
+{
+    // the strings share long prefixes, so sorting them runs into the
+    // recursion limit and has to fall back to std::sort
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::string> to_sort;
+    for (int i = 0; i < 10000; ++i)
+        to_sort.push_back(std::string(10, 'a') + std::to_string(randomness() % 1000));
+    std::vector<std::string> copy = to_sort;
+    ska_sort(to_sort.begin(), to_sort.end(), [](const std::string & s) -> const std::string &{ return s; }, ska_sort_policy<1, 1, 4>());
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, to_sort);
+}
+struct CustomPolicy
+{
+    static constexpr std::ptrdiff_t std_sort_threshold = 32;
+    static constexpr std::ptrdiff_t american_flag_sort_threshold = 4096;
+    static constexpr size_t list_recursion_limit = 8;
+    using small_sort = std_sort_small_sort;
+};
+TEST(ska_sort_policy, custom_type)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::pair<uint64_t, std::string>> to_sort;
+    for (int i = 0; i < 10000; ++i)
+        to_sort.emplace_back(randomness() % 100, std::to_string(randomness() % 100));
+    std::vector<std::pair<uint64_t, std::string>> copy = to_sort;
+    ska_sort(to_sort.begin(), to_sort.end(), [](auto && p) -> decltype(auto){ return p; }, CustomPolicy());
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, to_sort);
+}
+
+TEST(ska_sort_policy, cached_key_small_sort)
+{
+    // the keys get built by extract_key, so these go through the cached keys
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::pair<std::string, int32_t>> to_sort;
+    for (int i = 0; i < 10000; ++i)
+        to_sort.emplace_back(std::to_string(randomness() % 1000), static_cast<int32_t>(randomness() % 100));
+    std::vector<std::pair<std::string, int32_t>> copy = to_sort;
+    ska_sort(to_sort.begin(), to_sort.end(), [](const std::pair<std::string, int32_t> & p)
+    {
+        return std::tie(p.second, p.first);
+    }, ska_sort_policy<128, 1024, 16, cached_key_small_sort>());
+    std::sort(copy.begin(), copy.end(), [](const std::pair<std::string, int32_t> & l, const std::pair<std::string, int32_t> & r)
+    {
+        return std::tie(l.second, l.first) < std::tie(r.second, r.first);
+    });
+    ASSERT_EQ(copy, to_sort);
+}
+TEST(ska_sort_policy, cached_key_small_sort_number_keys)
+{
+    // moving strings is expensive, so these go through the packed keys
+    std::mt19937_64 randomness(77342348);
+    for (int size : { 0, 1, 2, 3, 5, 8, 13, 16, 17, 31, 32, 33, 100, 256, 257 })
+    {
+        std::vector<std::pair<int32_t, std::string>> small_keys;
+        std::vector<std::pair<int64_t, std::string>> large_keys;
+        for (int i = 0; i < size; ++i)
+        {
+            int64_t key = static_cast<int64_t>(randomness() % 50) - 25;
+            small_keys.emplace_back(static_cast<int32_t>(key), std::to_string(i));
+            large_keys.emplace_back(key * 1000000000000, std::to_string(i));
+        }
+        auto small_copy = small_keys;
+        auto large_copy = large_keys;
+        auto small_key = [](const std::pair<int32_t, std::string> & p){ return p.first; };
+        auto large_key = [](const std::pair<int64_t, std::string> & p){ return p.first; };
+        cached_key_small_sort::sort(small_keys.begin(), small_keys.end(), small_key);
+        cached_key_small_sort::sort(large_keys.begin(), large_keys.end(), large_key);
+        std::stable_sort(small_copy.begin(), small_copy.end(), [](auto & l, auto & r){ return l.first < r.first; });
+        std::stable_sort(large_copy.begin(), large_copy.end(), [](auto & l, auto & r){ return l.first < r.first; });
+        for (int i = 0; i < size; ++i)
+        {
+            ASSERT_EQ(small_copy[i].first, small_keys[i].first);
+            ASSERT_EQ(large_copy[i].first, large_keys[i].first);
+        }
+        // every element has to be there exactly once
+        std::sort(small_copy.begin(), small_copy.end());
+        std::sort(small_keys.begin(), small_keys.end());
+        ASSERT_EQ(small_copy, small_keys);
+        std::sort(large_copy.begin(), large_copy.end());
+        std::sort(large_keys.begin(), large_keys.end());
+        ASSERT_EQ(large_copy, large_keys);
+    }
+}
+TEST(ska_sort_policy, cached_key_small_sort_default)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::string> strings;
+    for (int i = 0; i < 10000; ++i)
+        strings.push_back(std::to_string(randomness() % 100000));
+    std::vector<std::string> strings_copy = strings;
+    ska_sort(strings.begin(), strings.end());
+    std::sort(strings_copy.begin(), strings_copy.end());
+    ASSERT_EQ(strings_copy, strings);
+
+    std::vector<bool> bools;
+    for (int i = 0; i < 1000; ++i)
+        bools.push_back(randomness() % 2 == 0);
+    std::vector<bool> bools_copy = bools;
+    ska_sort(bools.begin(), bools.end());
+    std::sort(bools_copy.begin(), bools_copy.end());
+    ASSERT_EQ(bools_copy, bools);
+}
+
+TEST(ska_sort, presorted)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::string> sorted(10000);
+    std::generate(sorted.begin(), sorted.end(), [&]{ return std::to_string(randomness() % 100000); });
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<std::string> reversed(sorted.rbegin(), sorted.rend());
+    std::vector<std::string> with_tail = sorted;
+    for (int i = 0; i < 1000; ++i)
+        with_tail.push_back(std::to_string(randomness() % 100000));
+    std::vector<std::string> with_long_tail = sorted;
+    for (int i = 0; i < 5000; ++i)
+        with_long_tail.push_back(std::to_string(randomness() % 100000));
+    for (std::vector<std::string> to_sort : { sorted, reversed, with_tail, with_long_tail })
+    {
+        std::vector<std::string> copy = to_sort;
+        std::vector<std::string> parallel = to_sort;
+        ska_sort(to_sort.begin(), to_sort.end());
+        std::sort(copy.begin(), copy.end());
+        ASSERT_EQ(copy, to_sort);
+        parallel_ska_sort(parallel.begin(), parallel.end(), [](const std::string & s) -> const std::string &{ return s; }, 4);
+        ASSERT_EQ(copy, parallel);
+    }
+}
+TEST(ska_sort, presorted_bool_deque)
+{
+    // the tail gets merged from a std::vector<bool>, whose elements are
+    // proxies that get compared with the bool references of the deque
+    std::deque<bool> to_sort(1000, false);
+    std::fill(to_sort.begin() + 500, to_sort.end(), true);
+    for (int i = 0; i < 50; ++i)
+        to_sort.push_back(i % 2 == 0);
+    std::deque<bool> copy = to_sort;
+    ska_sort(to_sort.begin(), to_sort.end());
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, to_sort);
+}
+
+TEST(ska_sort, narrow_key_range)
+{
+    std::mt19937_64 randomness(77342348);
+    for (int64_t base : { int64_t(123456789012345), int64_t(-1000), int64_t(-123456789012345) })
+    {
+        std::vector<int64_t> to_sort(100000);
+        std::generate(to_sort.begin(), to_sort.end(), [&]{ return base + static_cast<int64_t>(randomness() % (1 << 20)); });
+        std::vector<int64_t> copy = to_sort;
+        ska_sort(to_sort.begin(), to_sort.end());
+        std::sort(copy.begin(), copy.end());
+        ASSERT_EQ(copy, to_sort);
+    }
+}
+TEST(ska_sort, narrow_key_range_in_pair)
+{
+    // the first key is the same everywhere, so it skips straight to the
+    // second key, which only uses its lowest byte
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::pair<uint32_t, uint16_t>> to_sort(10000);
+    std::generate(to_sort.begin(), to_sort.end(), [&]{ return std::make_pair(uint32_t(77), static_cast<uint16_t>(randomness() % 200)); });
+    std::vector<std::pair<uint32_t, uint16_t>> copy = to_sort;
+    ska_sort(to_sort.begin(), to_sort.end());
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, to_sort);
+}
+
+TEST(ska_sort, clustered_keys)
+{
+    // after the first byte, every partition shares the next five bytes
+    std::mt19937_64 randomness(77342348);
+    std::vector<uint64_t> to_sort(100000);
+    std::generate(to_sort.begin(), to_sort.end(), [&]{ return ((randomness() % 16) << 56) | (randomness() % (1 << 16)); });
+    std::vector<uint64_t> copy = to_sort;
+    ska_sort(to_sort.begin(), to_sort.end());
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, to_sort);
+
+    // every partition after the first byte has only one key, so they go
+    // straight to the second element of the pair
+    std::vector<std::pair<int64_t, int32_t>> pairs(100000);
+    std::generate(pairs.begin(), pairs.end(), [&]{ return std::make_pair(static_cast<int64_t>(randomness() % 4) << 56, static_cast<int32_t>(randomness())); });
+    std::vector<std::pair<int64_t, int32_t>> pairs_copy = pairs;
+    ska_sort(pairs.begin(), pairs.end());
+    std::sort(pairs_copy.begin(), pairs_copy.end());
+    ASSERT_EQ(pairs_copy, pairs);
+}
+
+#ifdef SKA_SORT_INT128
+TEST(ska_sort, int128)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<__int128> to_sort(100000);
+    std::generate(to_sort.begin(), to_sort.end(), [&]{ return static_cast<__int128>((static_cast<unsigned __int128>(randomness()) << 64) | randomness()); });
+    // a narrow range that crosses zero
+    for (size_t i = 0; i < to_sort.size(); i += 2)
+        to_sort[i] = static_cast<__int128>(randomness() % 1000) - 500;
+    std::vector<__int128> copy = to_sort;
+    std::vector<__int128> parallel = to_sort;
+    ska_sort(to_sort.begin(), to_sort.end());
+    parallel_ska_sort(parallel.begin(), parallel.end(), [](__int128 i){ return i; }, 4);
+    std::sort(copy.begin(), copy.end());
+    ASSERT_TRUE(copy == to_sort);
+    ASSERT_TRUE(copy == parallel);
+
+    std::vector<unsigned __int128> narrow(100000);
+    std::generate(narrow.begin(), narrow.end(), [&]{ return (static_cast<unsigned __int128>(12345) << 100) + randomness() % 100000; });
+    std::vector<unsigned __int128> narrow_copy = narrow;
+    ska_sort(narrow.begin(), narrow.end());
+    std::sort(narrow_copy.begin(), narrow_copy.end());
+    ASSERT_TRUE(narrow_copy == narrow);
+}
+#endif
+TEST(ska_sort, byte_arrays)
+{
+    std::mt19937_64 randomness(77342348);
+    auto test = [&](auto array)
+    {
+        using array_type = decltype(array);
+        std::vector<array_type> to_sort(10000);
+        for (array_type & key : to_sort)
+        {
+            for (size_t j = 0; j < key.size(); ++j)
+                key[j] = static_cast<unsigned char>(j < 9 ? randomness() % 3 : randomness());
+        }
+        std::vector<array_type> copy = to_sort;
+        ska_sort(to_sort.begin(), to_sort.end());
+        std::sort(copy.begin(), copy.end());
+        ASSERT_EQ(copy, to_sort);
+        std::vector<std::pair<array_type, int>> pairs;
+        for (const array_type & key : to_sort)
+            pairs.emplace_back(key, static_cast<int>(randomness() % 100));
+        std::shuffle(pairs.begin(), pairs.end(), randomness);
+        std::vector<std::pair<array_type, int>> pairs_copy = pairs;
+        ska_sort(pairs.begin(), pairs.end());
+        std::sort(pairs_copy.begin(), pairs_copy.end());
+        ASSERT_EQ(pairs_copy, pairs);
+    };
+    test(std::array<uint8_t, 1>());
+    test(std::array<uint8_t, 3>());
+    test(std::array<uint8_t, 7>());
+    test(std::array<uint8_t, 16>());
+    test(std::array<uint8_t, 20>());
+}
+TEST(ska_sort, descending)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<int> ints(100000);
+    std::generate(ints.begin(), ints.end(), [&]{ return static_cast<int>(randomness()); });
+    std::vector<int> ints_copy = ints;
+    ska_sort(ints.begin(), ints.end(), [](int i){ return descending(i); });
+    std::sort(ints_copy.begin(), ints_copy.end(), std::greater<int>());
+    ASSERT_EQ(ints_copy, ints);
+
+    std::vector<double> doubles(10000);
+    std::generate(doubles.begin(), doubles.end(), [&]{ return static_cast<double>(static_cast<std::int64_t>(randomness() % 20000) - 10000) / 7.0; });
+    std::vector<double> doubles_copy = doubles;
+    ska_sort(doubles.begin(), doubles.end(), [](double d){ return descending(d); });
+    std::sort(doubles_copy.begin(), doubles_copy.end(), std::greater<double>());
+    ASSERT_EQ(doubles_copy, doubles);
+
+    std::vector<bool> bools(1000);
+    std::generate(bools.begin(), bools.end(), [&]{ return randomness() % 2 == 0; });
+    std::vector<bool> bools_copy = bools;
+    ska_sort(bools.begin(), bools.end(), [](bool b){ return descending(b); });
+    std::sort(bools_copy.begin(), bools_copy.end(), std::greater<bool>());
+    ASSERT_EQ(bools_copy, bools);
+}
+TEST(ska_sort, descending_strings)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::string> to_sort(10000);
+    for (std::string & str : to_sort)
+    {
+        // short strings from a small alphabet so that many are prefixes of others
+        size_t length = randomness() % 8;
+        for (size_t i = 0; i < length; ++i)
+            str += static_cast<char>('a' + randomness() % 3);
+    }
+    std::vector<std::string> copy = to_sort;
+    ska_sort(to_sort.begin(), to_sort.end(), [](const std::string & str){ return descending(str); });
+    std::sort(copy.begin(), copy.end(), std::greater<std::string>());
+    ASSERT_EQ(copy, to_sort);
+
+    std::vector<std::vector<std::string>> lists(10000);
+    for (std::vector<std::string> & list : lists)
+    {
+        size_t length = randomness() % 4;
+        for (size_t i = 0; i < length; ++i)
+            list.push_back(copy[randomness() % 20]);
+    }
+    std::vector<std::vector<std::string>> lists_copy = lists;
+    ska_sort(lists.begin(), lists.end(), [](const std::vector<std::string> & list){ return descending(list); });
+    std::sort(lists_copy.begin(), lists_copy.end(), std::greater<std::vector<std::string>>());
+    ASSERT_EQ(lists_copy, lists);
+}
+TEST(ska_sort, per_field_direction)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::tuple<int, std::string, std::uint64_t>> to_sort(10000);
+    for (auto & row : to_sort)
+    {
+        std::get<0>(row) = static_cast<int>(randomness() % 10) - 5;
+        std::get<1>(row) = std::string(randomness() % 3, static_cast<char>('a' + randomness() % 3));
+        std::get<2>(row) = randomness();
+    }
+    auto compare = [](const auto & l, const auto & r)
+    {
+        if (std::get<0>(l) != std::get<0>(r))
+            return std::get<0>(l) < std::get<0>(r);
+        if (std::get<1>(l) != std::get<1>(r))
+            return std::get<1>(l) > std::get<1>(r);
+        return std::get<2>(l) < std::get<2>(r);
+    };
+    auto copy = to_sort;
+    ska_sort(to_sort.begin(), to_sort.end(), [](const auto & row)
+    {
+        return std::make_tuple(std::get<0>(row), descending(std::get<1>(row)), std::get<2>(row));
+    });
+    std::sort(copy.begin(), copy.end(), compare);
+    ASSERT_EQ(copy, to_sort);
+
+    // the same through radix_sort, which is stable
+    std::vector<std::pair<int, std::uint16_t>> pairs(10000);
+    for (auto & pair : pairs)
+        pair = { static_cast<int>(randomness() % 100) - 50, static_cast<std::uint16_t>(randomness() % 50) };
+    std::vector<std::pair<int, std::uint16_t>> pairs_buffer(pairs.size());
+    std::vector<std::pair<int, std::uint16_t>> pairs_copy = pairs;
+    bool which_buffer = radix_sort(pairs.begin(), pairs.end(), pairs_buffer.begin(), [](const auto & pair)
+    {
+        return std::make_tuple(descending(pair.first), pair.second);
+    });
+    std::stable_sort(pairs_copy.begin(), pairs_copy.end(), [](const auto & l, const auto & r)
+    {
+        if (l.first != r.first)
+            return l.first > r.first;
+        return l.second < r.second;
+    });
+    ASSERT_EQ(pairs_copy, which_buffer ? pairs_buffer : pairs);
+
+    // equal keys keep their order when sorting descending
+    std::vector<std::pair<std::uint8_t, int>> stable(10000);
+    for (size_t i = 0; i < stable.size(); ++i)
+        stable[i] = { static_cast<std::uint8_t>(randomness() % 8), static_cast<int>(i) };
+    std::vector<std::pair<std::uint8_t, int>> stable_buffer(stable.size());
+    std::vector<std::pair<std::uint8_t, int>> stable_copy = stable;
+    which_buffer = radix_sort(stable.begin(), stable.end(), stable_buffer.begin(), [](const auto & pair){ return descending(pair.first); });
+    std::stable_sort(stable_copy.begin(), stable_copy.end(), [](const auto & l, const auto & r){ return l.first > r.first; });
+    ASSERT_EQ(stable_copy, which_buffer ? stable_buffer : stable);
+}
+TEST(ska_argsort, ints)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<int> to_sort(100000);
+    std::generate(to_sort.begin(), to_sort.end(), [&]{ return static_cast<int>(randomness() % 1000) - 500; });
+    std::vector<std::uint32_t> indices(to_sort.size());
+    ska_argsort(to_sort.begin(), to_sort.end(), indices.begin());
+    std::vector<int> sorted;
+    for (std::uint32_t index : indices)
+        sorted.push_back(to_sort[index]);
+    std::vector<int> copy = to_sort;
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, sorted);
+
+    std::vector<std::uint32_t> expected(to_sort.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+        expected[i] = static_cast<std::uint32_t>(i);
+    std::stable_sort(expected.begin(), expected.end(), [&](std::uint32_t l, std::uint32_t r){ return to_sort[l] < to_sort[r]; });
+    std::vector<size_t> stable_indices(to_sort.size());
+    radix_argsort(to_sort.begin(), to_sort.end(), stable_indices.begin());
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(), stable_indices.begin()));
+}
+TEST(ska_argsort, radix_key_only)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<RadixKeyOnly> to_sort(10000);
+    for (RadixKeyOnly & money : to_sort)
+        money.cents = static_cast<long>(randomness() % 1000) - 500;
+    std::vector<std::uint32_t> expected(to_sort.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+        expected[i] = static_cast<std::uint32_t>(i);
+    std::stable_sort(expected.begin(), expected.end(), [&](std::uint32_t l, std::uint32_t r){ return to_sort[l].cents < to_sort[r].cents; });
+    // keys returned by value get cached, references get read from the elements
+    std::vector<std::uint32_t> cached(to_sort.size());
+    radix_argsort(to_sort.begin(), to_sort.end(), cached.begin(), [](const RadixKeyOnly & money){ return money; });
+    ASSERT_EQ(expected, cached);
+    std::vector<std::uint32_t> referenced(to_sort.size());
+    radix_argsort(to_sort.begin(), to_sort.end(), referenced.begin());
+    ASSERT_EQ(expected, referenced);
+}
+TEST(ska_argsort, records)
+{
+    struct Record
+    {
+        std::uint64_t id;
+        std::string name;
+        char payload[64];
+    };
+    std::mt19937_64 randomness(77342348);
+    std::vector<Record> records(10000);
+    for (Record & record : records)
+    {
+        record.id = randomness() % 5000;
+        record.name = std::to_string(randomness() % 500);
+    }
+    auto check_stable = [&](auto extract_key)
+    {
+        std::vector<std::uint32_t> expected(records.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+            expected[i] = static_cast<std::uint32_t>(i);
+        std::stable_sort(expected.begin(), expected.end(), [&](std::uint32_t l, std::uint32_t r){ return extract_key(records[l]) < extract_key(records[r]); });
+        std::vector<std::uint32_t> indices(records.size());
+        radix_argsort(records.begin(), records.end(), indices.begin(), extract_key);
+        ASSERT_EQ(expected, indices);
+    };
+    auto check = [&](auto extract_key)
+    {
+        std::vector<std::uint32_t> indices(records.size());
+        ska_argsort(records.begin(), records.end(), indices.begin(), extract_key);
+        ASSERT_TRUE(std::is_sorted(indices.begin(), indices.end(), [&](std::uint32_t l, std::uint32_t r){ return extract_key(records[l]) < extract_key(records[r]); }));
+        // every index shows up once
+        std::vector<std::uint32_t> sorted_indices = indices;
+        std::sort(sorted_indices.begin(), sorted_indices.end());
+        for (size_t i = 0; i < sorted_indices.size(); ++i)
+            ASSERT_EQ(i, sorted_indices[i]);
+    };
+    check_stable([](const Record & record){ return record.id; });
+    check_stable([](const Record & record){ return std::make_pair(static_cast<std::uint16_t>(record.id % 100), descending(record.id)); });
+    check([](const Record & record){ return record.id; });
+    check([](const Record & record) -> const std::string & { return record.name; });
+    check([](const Record & record){ return std::make_tuple(record.name, descending(record.id)); });
+}
+TEST(ska_sort, large_records)
+{
+    struct Record
+    {
+        std::uint64_t id;
+        std::string name;
+        std::array<std::uint64_t, 40> payload;
+    };
+    static_assert(sizeof(Record) >= SKA_SORT_KEY_INDEX_THRESHOLD, "has to use the key index sort");
+    std::mt19937_64 randomness(77342348);
+    std::vector<Record> records(10000);
+    for (Record & record : records)
+    {
+        record.id = randomness() % 5000;
+        record.name = std::to_string(randomness() % 500);
+        record.payload.fill(record.id);
+    }
+    auto check = [&](auto extract_key)
+    {
+        std::vector<Record> to_sort = records;
+        std::vector<Record> copy = records;
+        auto compare = [&](const Record & l, const Record & r){ return extract_key(l) < extract_key(r); };
+        ska_sort(to_sort.begin(), to_sort.end(), extract_key);
+        ASSERT_TRUE(std::is_sorted(to_sort.begin(), to_sort.end(), compare));
+        std::sort(copy.begin(), copy.end(), compare);
+        for (size_t i = 0; i < copy.size(); ++i)
+        {
+            ASSERT_FALSE(compare(copy[i], to_sort[i]) || compare(to_sort[i], copy[i]));
+            ASSERT_EQ(to_sort[i].id, to_sort[i].payload.back());
+        }
+    };
+    check([](const Record & record){ return record.id; });
+    check([](const Record & record) -> const std::string & { return record.name; });
+    check([](const Record & record){ return std::make_tuple(std::cref(record.name), descending(record.id)); });
+}
+TEST(radix_sort, large_records)
+{
+    struct Record
+    {
+        std::uint32_t id;
+        std::array<std::uint32_t, 20> payload;
+    };
+    static_assert(sizeof(Record) >= SKA_SORT_RADIX_SORT_KEY_INDEX_THRESHOLD, "has to use the key index sort");
+    std::mt19937_64 randomness(77342348);
+    std::vector<Record> to_sort(10000);
+    for (size_t i = 0; i < to_sort.size(); ++i)
+    {
+        to_sort[i].id = static_cast<std::uint32_t>(randomness() % 1000);
+        to_sort[i].payload.fill(static_cast<std::uint32_t>(i));
+    }
+    auto compare = [](const Record & l, const Record & r){ return l.id < r.id; };
+    std::vector<Record> copy = to_sort;
+    std::stable_sort(copy.begin(), copy.end(), compare);
+    std::vector<Record> buffer(to_sort.size());
+    bool which_buffer = radix_sort(to_sort.begin(), to_sort.end(), buffer.begin(), [](const Record & record){ return record.id; });
+    std::vector<Record> & sorted = which_buffer ? buffer : to_sort;
+    for (size_t i = 0; i < copy.size(); ++i)
+    {
+        ASSERT_EQ(copy[i].id, sorted[i].id);
+        ASSERT_EQ(copy[i].payload, sorted[i].payload);
+    }
+}
+TEST(ska_sort_columns, payloads)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::int64_t> keys(10000);
+    std::vector<std::string> names(keys.size());
+    std::vector<double> values(keys.size());
+    std::vector<std::tuple<std::int64_t, std::string, double>> rows;
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        keys[i] = static_cast<std::int64_t>(randomness() % 1000) - 500;
+        names[i] = std::to_string(randomness());
+        values[i] = static_cast<double>(i);
+        rows.emplace_back(keys[i], names[i], values[i]);
+    }
+    ska_sort_columns(keys.begin(), keys.end(), names.begin(), values.begin());
+    ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    std::vector<std::tuple<std::int64_t, std::string, double>> sorted_rows;
+    for (size_t i = 0; i < keys.size(); ++i)
+        sorted_rows.emplace_back(keys[i], names[i], values[i]);
+    std::sort(rows.begin(), rows.end());
+    std::sort(sorted_rows.begin(), sorted_rows.end());
+    ASSERT_EQ(rows, sorted_rows);
+}
+TEST(ska_sort_columns, stable)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::uint16_t> keys(10000);
+    std::vector<std::uint32_t> positions(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        keys[i] = static_cast<std::uint16_t>(randomness() % 100);
+        positions[i] = static_cast<std::uint32_t>(i);
+    }
+    std::vector<std::pair<std::uint16_t, std::uint32_t>> rows;
+    for (size_t i = 0; i < keys.size(); ++i)
+        rows.emplace_back(keys[i], positions[i]);
+    std::stable_sort(rows.begin(), rows.end(), [](const auto & l, const auto & r){ return l.first < r.first; });
+    radix_sort_columns(keys.begin(), keys.end(), positions.begin());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        ASSERT_EQ(rows[i].first, keys[i]);
+        ASSERT_EQ(rows[i].second, positions[i]);
+    }
+
+    // string keys go through the in place sort
+    std::vector<std::string> names(1000);
+    std::vector<int> ids(names.size());
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        names[i] = std::to_string(randomness() % 100);
+        ids[i] = std::stoi(names[i]);
+    }
+    ska_sort_columns(names.begin(), names.end(), ids.begin());
+    ASSERT_TRUE(std::is_sorted(names.begin(), names.end()));
+    for (size_t i = 0; i < names.size(); ++i)
+        ASSERT_EQ(std::to_string(ids[i]), names[i]);
+}
+TEST(ska_sort_columns, no_copy)
+{
+    // the sort reads the keys by reference, so keys that can't be copied
+    // work, and string keys don't get copied on every read
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::string> names(10000);
+    std::generate(names.begin(), names.end(), [&]{ return std::to_string(randomness() % 5000); });
+    std::vector<MovableString> keys;
+    std::vector<size_t> rows(names.size());
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        keys.emplace_back(names[i].c_str());
+        rows[i] = i;
+    }
+    ska_sort_columns(keys.begin(), keys.end(), rows.begin());
+    std::vector<std::string> sorted = names;
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        ASSERT_EQ(sorted[i], to_radix_sort_key(keys[i]));
+        ASSERT_EQ(names[rows[i]], to_radix_sort_key(keys[i]));
+    }
+}
+TEST(stable_ska_sort, bounded_buffer)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::pair<std::uint16_t, std::uint32_t>> to_sort(100000);
+    for (size_t i = 0; i < to_sort.size(); ++i)
+        to_sort[i] = { static_cast<std::uint16_t>(randomness() % 1000), static_cast<std::uint32_t>(i) };
+    std::vector<std::pair<std::uint16_t, std::uint32_t>> copy = to_sort;
+    auto key = [](const std::pair<std::uint16_t, std::uint32_t> & pair){ return pair.first; };
+    std::stable_sort(copy.begin(), copy.end(), [&](const auto & l, const auto & r){ return key(l) < key(r); });
+    // a tiny buffer forces merges that rotate
+    for (std::ptrdiff_t buffer_size : { 0, 1, 7, 1000, 100000 })
+    {
+        std::vector<std::pair<std::uint16_t, std::uint32_t>> sorted = to_sort;
+        stable_ska_sort(sorted.begin(), sorted.end(), key, buffer_size);
+        ASSERT_EQ(copy, sorted);
+    }
+
+    // the merges look at elements through the proxy references of
+    // std::vector<bool>
+    std::vector<bool> bools(1000);
+    std::generate(bools.begin(), bools.end(), [&]{ return randomness() % 2 == 0; });
+    std::vector<bool> bools_copy = bools;
+    std::sort(bools_copy.begin(), bools_copy.end());
+    for (std::ptrdiff_t buffer_size : { 1, 7 })
+    {
+        std::vector<bool> sorted = bools;
+        stable_ska_sort(sorted.begin(), sorted.end(), [](bool b){ return b; }, buffer_size);
+        ASSERT_EQ(bools_copy, sorted);
+    }
+}
+TEST(stable_ska_sort, bounded_buffer_radix_order)
+{
+    // the merges have to use the order of the radix sort, which puts NaNs
+    // last, and has to work for keys without operator<
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::pair<double, std::uint32_t>> doubles(20000);
+    for (size_t i = 0; i < doubles.size(); ++i)
+    {
+        double value = i % 7 == 0 ? std::numeric_limits<double>::quiet_NaN() : static_cast<double>(randomness() % 1000);
+        doubles[i] = { value, static_cast<std::uint32_t>(i) };
+    }
+    std::vector<std::pair<RadixKeyOnly, std::uint32_t>> custom(20000);
+    for (size_t i = 0; i < custom.size(); ++i)
+        custom[i] = { RadixKeyOnly{ static_cast<long>(randomness() % 1000) - 500 }, static_cast<std::uint32_t>(i) };
+    std::vector<std::pair<double, std::uint32_t>> doubles_copy = doubles;
+    std::stable_sort(doubles_copy.begin(), doubles_copy.end(), [](const auto & l, const auto & r){ return !std::isnan(l.first) && (std::isnan(r.first) || l.first < r.first); });
+    std::vector<std::pair<RadixKeyOnly, std::uint32_t>> custom_copy = custom;
+    std::stable_sort(custom_copy.begin(), custom_copy.end(), [](const auto & l, const auto & r){ return l.first.cents < r.first.cents; });
+    for (std::ptrdiff_t buffer_size : { 1, 100, 100000 })
+    {
+        std::vector<std::pair<double, std::uint32_t>> sorted_doubles = doubles;
+        stable_ska_sort(sorted_doubles.begin(), sorted_doubles.end(), [](const auto & p){ return p.first; }, buffer_size);
+        std::vector<std::pair<RadixKeyOnly, std::uint32_t>> sorted_custom = custom;
+        stable_ska_sort(sorted_custom.begin(), sorted_custom.end(), [](const auto & p) -> const RadixKeyOnly &{ return p.first; }, buffer_size);
+        for (size_t i = 0; i < doubles.size(); ++i)
+        {
+            ASSERT_EQ(doubles_copy[i].second, sorted_doubles[i].second);
+            ASSERT_EQ(custom_copy[i].second, sorted_custom[i].second);
+        }
+    }
+}
+TEST(stable_ska_sort, keys)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<double> doubles(50000);
+    std::generate(doubles.begin(), doubles.end(), [&]{ return static_cast<double>(static_cast<std::int64_t>(randomness() % 2000) - 1000) / 3.0; });
+    std::vector<double> copy = doubles;
+    stable_ska_sort(doubles.begin(), doubles.end());
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, doubles);
+
+    std::vector<std::tuple<int, std::uint8_t, std::string>> rows(10000);
+    for (auto & row : rows)
+        row = std::make_tuple(static_cast<int>(randomness() % 10) - 5, static_cast<std::uint8_t>(randomness()), std::to_string(randomness()));
+    auto rows_copy = rows;
+    auto key = [](const auto & row){ return std::make_tuple(std::get<0>(row), descending(std::get<1>(row))); };
+    stable_ska_sort(rows.begin(), rows.end(), key, 100);
+    std::stable_sort(rows_copy.begin(), rows_copy.end(), [&](const auto & l, const auto & r){ return key(l) < key(r); });
+    ASSERT_EQ(rows_copy, rows);
+
+    std::vector<int> empty;
+    stable_ska_sort(empty.begin(), empty.end());
+}
+TEST(stable_ska_sort_copy, strings)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::pair<std::string, int>> to_sort(50000);
+    for (size_t i = 0; i < to_sort.size(); ++i)
+    {
+        // many equal strings and many that are prefixes of others
+        size_t length = randomness() % 6;
+        for (size_t j = 0; j < length; ++j)
+            to_sort[i].first += static_cast<char>('a' + randomness() % 2);
+        to_sort[i].second = static_cast<int>(i);
+    }
+    auto key = [](const std::pair<std::string, int> & pair) -> const std::string & { return pair.first; };
+    std::vector<std::pair<std::string, int>> copy = to_sort;
+    std::stable_sort(copy.begin(), copy.end(), [&](const auto & l, const auto & r){ return key(l) < key(r); });
+    std::vector<std::pair<std::string, int>> buffer(to_sort.size());
+    ASSERT_TRUE(stable_ska_sort_copy(to_sort.begin(), to_sort.end(), buffer.begin(), key));
+    ASSERT_EQ(copy, buffer);
+}
+TEST(stable_ska_sort_copy, multi_key)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::tuple<std::string, std::vector<int>, int>> to_sort(10000);
+    for (size_t i = 0; i < to_sort.size(); ++i)
+    {
+        std::get<0>(to_sort[i]) = std::to_string(randomness() % 10);
+        for (size_t j = randomness() % 3; j > 0; --j)
+            std::get<1>(to_sort[i]).push_back(static_cast<int>(randomness() % 3) - 1);
+        std::get<2>(to_sort[i]) = static_cast<int>(i);
+    }
+    auto key = [](const auto & row){ return std::make_tuple(descending(std::get<0>(row)), std::get<1>(row)); };
+    auto copy = to_sort;
+    std::stable_sort(copy.begin(), copy.end(), [&](const auto & l, const auto & r){ return key(l) < key(r); });
+    decltype(to_sort) buffer(to_sort.size());
+    stable_ska_sort_copy(to_sort.begin(), to_sort.end(), buffer.begin(), key);
+    ASSERT_EQ(copy, buffer);
+
+    std::vector<int> ints = { 3, 1, 2 };
+    std::vector<int> ints_buffer(ints.size());
+    stable_ska_sort_copy(ints.begin(), ints.end(), ints_buffer.begin());
+    ASSERT_EQ((std::vector<int>{ 1, 2, 3 }), ints_buffer);
+}
+TEST(ska_sort, cached_string_keys)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<std::string> prefixes = { "https://www.example.com/", "https://www.example.org/path/", "http://", "" };
+    std::vector<std::pair<std::string, int>> to_sort(50000);
+    for (auto & pair : to_sort)
+    {
+        std::string & str = pair.first;
+        str = prefixes[randomness() % prefixes.size()];
+        for (size_t i = randomness() % 12; i > 0; --i)
+            str += static_cast<char>(randomness() % 3);
+        if (randomness() % 4 == 0)
+            str += static_cast<char>(0xff);
+        pair.second = static_cast<int>(randomness() % 5);
+    }
+    std::vector<std::string> strings;
+    for (const auto & pair : to_sort)
+        strings.push_back(pair.first);
+    std::vector<std::string> strings_copy = strings;
+    ska_sort(strings.begin(), strings.end());
+    std::sort(strings_copy.begin(), strings_copy.end());
+    ASSERT_EQ(strings_copy, strings);
+
+    // equal strings get sorted by the second member
+    std::vector<std::pair<std::string, int>> copy = to_sort;
+    ska_sort(to_sort.begin(), to_sort.end());
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, to_sort);
+
+    std::vector<std::vector<std::uint8_t>> byte_lists(10000);
+    for (auto & list : byte_lists)
+    {
+        list.assign(16, 7);
+        for (size_t i = randomness() % 10; i > 0; --i)
+            list.push_back(static_cast<std::uint8_t>(randomness() % 2));
+    }
+    auto byte_lists_copy = byte_lists;
+    ska_sort(byte_lists.begin(), byte_lists.end());
+    std::sort(byte_lists_copy.begin(), byte_lists_copy.end());
+    ASSERT_EQ(byte_lists_copy, byte_lists);
+}
+TEST(ska_sort, long_common_prefixes)
+{
+    std::mt19937_64 randomness(77342348);
+    auto test = [&](auto make_list)
+    {
+        using list_type = decltype(make_list(0));
+        // fewer elements than the cached string sort takes, so that every
+        // level finds the common prefix
+        std::vector<list_type> to_sort(2000);
+        for (list_type & list : to_sort)
+            list = make_list(randomness());
+        std::vector<list_type> copy = to_sort;
+        ska_sort(to_sort.begin(), to_sort.end());
+        std::sort(copy.begin(), copy.end());
+        ASSERT_EQ(copy, to_sort);
+    };
+    const std::string prefix = "/api/v2/customers/0123456789/orders/abcdefghijklmnopqrstuvwxyz/";
+    test([&](std::uint64_t random)
+    {
+        std::string result = prefix.substr(0, prefix.size() - random % 3);
+        for (size_t i = random % 7; i > 0; --i)
+            result += static_cast<char>('a' + (random >> (i * 3)) % 3);
+        return result;
+    });
+    test([&](std::uint64_t random)
+    {
+        std::u16string result(std::u16string(40, u'x') + static_cast<char16_t>(0x1000 + random % 3));
+        result.resize(result.size() + random % 5 / 4, static_cast<char16_t>(random >> 8));
+        return result;
+    });
+    test([&](std::uint64_t random)
+    {
+        std::u32string result(std::u32string(random % 2 ? 33 : 34, U'y'));
+        result += static_cast<char32_t>(random % 5);
+        return result;
+    });
+    test([&](std::uint64_t random)
+    {
+        std::vector<int> result(37, -1);
+        result.push_back(static_cast<int>(random % 7) - 3);
+        if (random % 3 == 0)
+            result.push_back(1);
+        return result;
+    });
+}
+
+TEST(parallel_ska_sort, int64)
+{
+    std::mt19937_64 randomness(77342348);
+    std::uniform_int_distribution<int64_t> distribution(std::numeric_limits<int64_t>::lowest(), std::numeric_limits<int64_t>::max());
+    std::vector<int64_t> to_sort(100000);
+    std::generate(to_sort.begin(), to_sort.end(), [&]{ return distribution(randomness); });
+    std::vector<int64_t> copy = to_sort;
+    parallel_ska_sort(to_sort.begin(), to_sort.end(), [](int64_t i){ return i; }, 4);
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, to_sort);
+}
+TEST(parallel_ska_sort, skewed)
+{
+    // all elements share the top bytes and most share one value
+    std::mt19937_64 randomness(77342348);
+    std::uniform_int_distribution<int32_t> distribution(0, 1000);
+    std::vector<int32_t> to_sort(100000);
+    std::generate(to_sort.begin(), to_sort.end(), [&]
+    {
+        int32_t value = distribution(randomness);
+        return value < 900 ? 5 : value;
+    });
+    std::vector<int32_t> copy = to_sort;
+    parallel_ska_sort(to_sort.begin(), to_sort.end(), [](int32_t i){ return i; }, 3);
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, to_sort);
+}
+TEST(parallel_ska_sort, pair_with_strings)
+{
+    std::mt19937_64 randomness(77342348);
+    std::uniform_int_distribution<int> distribution(0, 100);
+    std::vector<std::pair<int, std::string>> to_sort;
+    for (int i = 0; i < 100000; ++i)
+        to_sort.emplace_back(distribution(randomness), std::to_string(distribution(randomness)));
+    std::vector<std::pair<int, std::string>> copy = to_sort;
+    parallel_ska_sort(to_sort.begin(), to_sort.end(), [](auto && p) -> decltype(auto){ return p; }, 4);
+    std::sort(copy.begin(), copy.end());
+    ASSERT_EQ(copy, to_sort);
+}
+TEST(parallel_ska_sort, small)
+{
+    std::vector<int> to_sort = { 5, 3, 7, -1, 0, 12 };
+    parallel_ska_sort(to_sort.begin(), to_sort.end());
+    ASSERT_TRUE(std::is_sorted(to_sort.begin(), to_sort.end()));
+}
+
+TEST(parallel_radix_sort, uint64)
+{
+    std::mt19937_64 randomness(77342348);
+    std::vector<uint64_t> to_sort(100000);
+    std::generate(to_sort.begin(), to_sort.end(), [&]{ return randomness(); });
+    std::vector<uint64_t> result(to_sort.size());
+    bool which_buffer = parallel_radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](uint64_t i){ return i; }, 4);
+    if (which_buffer)
+        std::sort(to_sort.begin(), to_sort.end());
+    else
+        std::sort(result.begin(), result.end());
+    ASSERT_EQ(to_sort, result);
+}
+TEST(parallel_radix_sort, stable_pair)
+{
+    std::mt19937_64 randomness(77342348);
+    std::uniform_int_distribution<int> distribution(-50, 50);
+    std::vector<std::pair<int8_t, int>> to_sort;
+    for (int i = 0; i < 100000; ++i)
+        to_sort.emplace_back(distribution(randomness), i);
+    std::vector<std::pair<int8_t, int>> result(to_sort.size());
+    bool which_buffer = parallel_radix_sort(to_sort.begin(), to_sort.end(), result.begin(), [](auto && p){ return p.first; }, 3);
+    std::vector<std::pair<int8_t, int>> & sorted = which_buffer ? result : to_sort;
+    std::vector<std::pair<int8_t, int>> & other = which_buffer ? to_sort : result;
+    std::sort(other.begin(), other.end());
+    ASSERT_EQ(other, sorted);
+}
+TEST(parallel_ska_sort_copy, tuple)
+{
+    std::mt19937_64 randomness(77342348);
+    std::uniform_int_distribution<int> distribution(0, 1000);
+    std::vector<std::tuple<bool, int16_t>> to_sort;
+    for (int i = 0; i < 100000; ++i)
+        to_sort.emplace_back(distribution(randomness) < 500, distribution(randomness));
+    std::vector<std::tuple<bool, int16_t>> result(to_sort.size());
+    bool which_buffer = parallel_ska_sort_copy(to_sort.begin(), to_sort.end(), result.begin(), [](auto && t){ return t; }, 4);
+    if (which_buffer)
+        std::sort(to_sort.begin(), to_sort.end());
+    else
+        std::sort(result.begin(), result.end());
+    ASSERT_EQ(to_sort, result);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();